@@ -0,0 +1,113 @@
+/*
+** aggregate.cpp - daylight and twilight totals per month and year
+**
+** A day's length at altitude h is twice the diurnal arc sunriset() computes:
+**
+**   cos(t) = (sin(h) - sin(lat)*sin(dec)) / (cos(lat)*cos(dec)),  length = 2*t/15 hours
+**
+** The sun's declination and distance only depend on the day, so they are computed once per day
+** of the year and shared by every site. Each site-day then costs three acos() calls.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+#include "table.h"
+#include "aggregate.h"
+
+#define AGGREGATE_ANGLES 3 /* Daylight, civil, nautical */
+
+typedef struct
+{
+  double sinDec;
+  double cosDec;
+  double sinAltitude[AGGREGATE_ANGLES];
+} aggregateDayStruct;
+
+static std::vector<aggregateDayStruct> sYear;
+
+/* Hours above the altitude whose sine is given: 0 in polar night, 24 in midnight sun */
+static inline double dayLength (double pSinAltitude, double pSinLat, double pCosLat, const aggregateDayStruct *pDay)
+{
+  double cost = (pSinAltitude - pSinLat * pDay->sinDec) / (pCosLat * pDay->cosDec);
+  if (cost >=  1.0) return 0.0;
+  if (cost <= -1.0) return 24.0;
+  return 2.0 * acosd (cost) / 15.0;
+}
+
+static void appendRow (std::string *pOutput, const siteStruct *pSite, const char *pPeriod, const double *pHours)
+{
+  char buffer[128];
+  snprintf ( buffer, sizeof (buffer), ",%s,%.2f,%.2f,%.2f\n"
+           , pPeriod, pHours[0], pHours[1] - pHours[0], pHours[2] - pHours[1]);
+  append_site (pOutput, pSite);
+  pOutput->append (buffer);
+}
+
+static void aggregateChunk (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput)
+{
+  double sinLat = sind (pSite->latitude);
+  double cosLat = cosd (pSite->latitude);
+  double year[AGGREGATE_ANGLES]  = { 0, 0, 0 };
+  double month[AGGREGATE_ANGLES] = { 0, 0, 0 };
+  unsigned int currentMonth = pTarget->month;
+  char period[16];
+
+  for (unsigned int day=0; day <= pDays; day++)
+  {
+    /* Close the month on the first day of the next, or after the last day */
+    if (day == pDays || pTarget->month != currentMonth)
+    { snprintf (period, sizeof (period), "%4.4u-%2.2u", pTarget->year - (day == pDays && currentMonth == 12), currentMonth);
+      appendRow (pOutput, pSite, period, month);
+      for (int a=0; a < AGGREGATE_ANGLES; a++) { year[a] += month[a]; month[a] = 0; }
+      currentMonth = pTarget->month;
+      if (day == pDays) break;
+    }
+
+    const aggregateDayStruct *ephemeris = &sYear[day];
+    for (int a=0; a < AGGREGATE_ANGLES; a++)
+      month[a] += dayLength (ephemeris->sinAltitude[a], sinLat, cosLat, ephemeris);
+
+    pTarget->daysSince2000++;
+    civilFromDaysSince2000 (pTarget->daysSince2000, &pTarget->year, &pTarget->month, &pTarget->dayOfMonth);
+  }
+
+  snprintf (period, sizeof (period), "%4.4u", pTarget->year - 1);
+  appendRow (pOutput, pSite, period, year);
+}
+
+boolean print_aggregate (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return false;
+
+  /* Whole target year */
+  targetStruct target  = *pTarget;
+  target.month         = 1;
+  target.dayOfMonth    = 1;
+  target.daysSince2000 = daysSince2000 (target.year, 1, 1);
+  unsigned int days    = (unsigned int) (daysSince2000 (target.year + 1, 1, 1) - target.daysSince2000);
+
+  /* Per-day ephemeris, with the same altitudes as sunriset() */
+  const double angles[AGGREGATE_ANGLES] = { TWILIGHT_ANGLE_DAYLIGHT, TWILIGHT_ANGLE_CIVIL, TWILIGHT_ANGLE_NAUTICAL };
+  sYear.resize (days);
+  for (unsigned int day=0; day < days; day++)
+  { ephemerisStruct ephemeris;
+    sun_ephemeris (target.daysSince2000 + day, &ephemeris);
+    sYear[day].sinDec = sind (ephemeris.sdec);
+    sYear[day].cosDec = cosd (ephemeris.sdec);
+    sYear[day].sinAltitude[0] = sind (angles[0] - 0.2666 / ephemeris.sr);
+    for (int a=1; a < AGGREGATE_ANGLES; a++) sYear[day].sinAltitude[a] = sind (angles[a]);
+  }
+
+  boolean ok = run_table_output (&target, &sites, days, 0, aggregateChunk);
+
+  sYear.clear ();
+  free_sites (&sites);
+  return ok;
+}
@@ -0,0 +1,13 @@
+#include "sunwait.h"
+
+#ifndef AGGREGATE_H
+  #define AGGREGATE_H
+
+/*
+** Hours of daylight, civil twilight and nautical twilight, per month and for the whole
+** target year, for each site (or the target's own location). One CSV row per site and period.
+** False if the output could not be written.
+*/
+boolean print_aggregate (targetStruct *pTarget);
+
+#endif
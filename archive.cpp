@@ -0,0 +1,378 @@
+/*
+** archive.cpp - delta-of-delta encoded rise/set archive
+**
+** Rise and set move by seconds to minutes a day, so their second differences are mostly a few
+** seconds and take one varint byte. Polar days and nights are long runs of one day type and
+** cost a few bytes a run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+#include "table.h"
+#include "archive.h"
+
+/*
+** >>>>> Encoding <<<<<
+*/
+
+static void putVarint (std::string *pOutput, uint64_t pValue)
+{
+  while (pValue >= 0x80) { pOutput->push_back ((char) (pValue | 0x80)); pValue >>= 7; }
+  pOutput->push_back ((char) pValue);
+}
+
+static uint64_t zigzag (int64_t pValue) { return ((uint64_t) pValue << 1) ^ (uint64_t) (pValue >> 63); }
+static int64_t  unzigzag (uint64_t pValue) { return (int64_t) (pValue >> 1) ^ -(int64_t) (pValue & 1); }
+
+static void putTimes (std::string *pOutput, const std::vector<int32_t> *pTimes)
+{
+  int64_t previous = 0, delta = 0;
+  for (size_t i=0; i < pTimes->size (); i++)
+  { int64_t value = (*pTimes)[i];
+    if (i == 0)      putVarint (pOutput, zigzag (value));
+    else if (i == 1) putVarint (pOutput, zigzag (value - previous));
+    else             putVarint (pOutput, zigzag (value - previous - delta));
+    if (i > 0) delta = value - previous;
+    previous = value;
+  }
+}
+
+static void putBlock (std::string *pOutput, const archiveDayStruct *pDays, unsigned int pCount)
+{
+  std::string runs;
+  unsigned int runCount = 0;
+  std::vector<int32_t> rise, set;
+  for (unsigned int i=0; i < pCount; )
+  { unsigned int length = 1;
+    while (i + length < pCount && pDays[i + length].dayType == pDays[i].dayType) length++;
+    runs.push_back ((char) pDays[i].dayType);
+    putVarint (&runs, length);
+    runCount++;
+    i += length;
+  }
+  for (unsigned int i=0; i < pCount; i++)
+    if (pDays[i].dayType == DAYTYPE_NORMAL) { rise.push_back (pDays[i].rise); set.push_back (pDays[i].set); }
+
+  putVarint (pOutput, runCount);
+  pOutput->append (runs);
+  putTimes (pOutput, &rise);
+  putTimes (pOutput, &set);
+}
+
+/* Sizes of each site's data, filled in by the chunks */
+static const siteListStruct *sSites;
+static std::vector<uint32_t> sDataSize;
+
+static void archiveChunk (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput)
+{
+  std::vector<archiveDayStruct> days (pDays);
+  for (unsigned int day=0; day < pDays; day++, pTarget->daysSince2000++)
+  { sunriset (pTarget);
+    days[day].dayType = pTarget->dayType;
+    days[day].rise    = pTarget->dayType == DAYTYPE_NORMAL ? (int32_t) floor (pTarget->riseTime * 3600.0) : 0;
+    days[day].set     = pTarget->dayType == DAYTYPE_NORMAL ? (int32_t) floor (pTarget->setTime  * 3600.0) : 0;
+  }
+
+  unsigned int blocks = (pDays + ARCHIVE_BLOCK_DAYS - 1) / ARCHIVE_BLOCK_DAYS;
+  pOutput->assign (blocks * sizeof (uint32_t), '\0');
+  for (unsigned int block=0; block < blocks; block++)
+  { uint32_t offset = pOutput->size ();
+    memcpy (&(*pOutput)[block * sizeof (uint32_t)], &offset, sizeof (offset));
+    unsigned int first = block * ARCHIVE_BLOCK_DAYS;
+    putBlock (pOutput, &days[first], pDays - first < ARCHIVE_BLOCK_DAYS ? pDays - first : ARCHIVE_BLOCK_DAYS);
+  }
+  sDataSize[pSite - sSites->sites] = pOutput->size ();
+}
+
+boolean write_archive (targetStruct *pTarget, const char *pFileName)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return false;
+  unsigned int days = pTarget->list > 0 ? pTarget->list : 365;
+
+  char temporary[4096];
+  snprintf (temporary, sizeof (temporary), "%s.tmp", pFileName);
+  FILE *file = fopen (temporary, "wb");
+  if (!file)
+  { printf ("Error: Unable to create archive: %s\n", temporary);
+    free_sites (&sites);
+    return false;
+  }
+
+  archiveHeader header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, ARCHIVE_MAGIC, 4);
+  header.blockDays     = ARCHIVE_BLOCK_DAYS;
+  header.firstDay      = pTarget->daysSince2000;
+  header.days          = days;
+  header.siteCount     = sites.count;
+  header.twilightAngle = pTarget->twilightAngle;
+  header.hourOffset    = pTarget->hourOffset;
+  fwrite (&header, sizeof (header), 1, file);
+
+  /* Each site's data is one chunk, streamed out in site order */
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  sSites = &sites;
+  sDataSize.assign (sites.count, 0);
+  run_table (pTarget, &sites, days, 0, archiveChunk, file);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  uint64_t offset = sizeof (header), nameOffset = 0;
+  for (size_t i=0; i < sites.count; i++)
+  { archiveSiteRecord record;
+    memset (&record, 0, sizeof (record));
+    record.latitude   = sites.sites[i].latitude;
+    record.longitude  = sites.sites[i].longitude;
+    record.dataOffset = offset;
+    record.dataSize   = sDataSize[i];
+    record.nameOffset = nameOffset;
+    record.nameLength = sites.sites[i].nameLength;
+    fwrite (&record, sizeof (record), 1, file);
+    offset     += sDataSize[i];
+    nameOffset += sites.sites[i].nameLength;
+  }
+  header.directoryOffset = offset;
+  header.namesOffset     = offset + sites.count * sizeof (archiveSiteRecord);
+  for (size_t i=0; i < sites.count; i++) fwrite (sites.sites[i].name, 1, sites.sites[i].nameLength, file);
+
+  fseek (file, 0, SEEK_SET);
+  fwrite (&header, sizeof (header), 1, file);
+  boolean ok = !ferror (file);
+  if (fclose (file) != 0 || !ok || rename (temporary, pFileName) != 0)
+  { printf ("Error: Unable to write archive: %s\n", pFileName);
+    remove (temporary);
+    ok = false;
+  }
+  else if (pTarget->debug == ONOFF_ON)
+  { /* Against 9 bytes a site-day raw: two 32-bit times and a day type */
+    double siteDays = (double) sites.count * days;
+    uint64_t size = header.namesOffset + nameOffset;
+    printf ( "Debug: Archive - %.0f site-days, %llu bytes, %.2f bytes per site-day, %.1fx smaller than raw, %.3f seconds.\n"
+           , siteDays, (unsigned long long) size, size / siteDays, 9.0 * siteDays / size, elapsed.count ());
+  }
+
+  sDataSize.clear ();
+  free_sites (&sites);
+  return ok;
+}
+
+/*
+** >>>>> Decoding <<<<<
+*/
+
+boolean archive_open (const char *pFileName, archiveStruct *pArchive)
+{
+  memset (pArchive, 0, sizeof (*pArchive));
+  int fd = open (pFileName, O_RDONLY);
+  struct stat status;
+  if (fd < 0 || fstat (fd, &status) != 0 || (size_t) status.st_size < sizeof (archiveHeader))
+  { printf ("Error: Unable to read archive: %s\n", pFileName);
+    if (fd >= 0) close (fd);
+    return false;
+  }
+
+  void *data = mmap (NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+  { printf ("Error: Unable to read archive: %s\n", pFileName);
+    return false;
+  }
+  pArchive->data   = (const char *) data;
+  pArchive->size   = status.st_size;
+  pArchive->header = (const archiveHeader *) data;
+  pArchive->sites  = (const archiveSiteRecord *) (pArchive->data + pArchive->header->directoryOffset);
+
+  const archiveHeader *header = pArchive->header;
+  if ( memcmp (header->magic, ARCHIVE_MAGIC, 4) || header->blockDays == 0
+    || header->directoryOffset + header->siteCount * sizeof (archiveSiteRecord) > pArchive->size
+    || header->namesOffset > pArchive->size)
+  { printf ("Error: Not a sunwait archive: %s\n", pFileName);
+    archive_close (pArchive);
+    return false;
+  }
+  for (size_t i=0; i < header->siteCount; i++)
+    if ( pArchive->sites[i].dataOffset + pArchive->sites[i].dataSize > pArchive->size
+      || header->namesOffset + pArchive->sites[i].nameOffset + pArchive->sites[i].nameLength > pArchive->size)
+    { printf ("Error: Damaged archive: %s\n", pFileName);
+      archive_close (pArchive);
+      return false;
+    }
+  return true;
+}
+
+void archive_close (archiveStruct *pArchive)
+{
+  if (pArchive->data) munmap ((void *) pArchive->data, pArchive->size);
+  memset (pArchive, 0, sizeof (*pArchive));
+}
+
+/* Varint at *pNext, bounded by pEnd. Truncated input reads as zero */
+static inline uint64_t getVarint (const unsigned char **pNext, const unsigned char *pEnd)
+{
+  uint64_t value = 0;
+  for (int shift = 0; *pNext < pEnd && shift < 64; shift += 7)
+  { unsigned char byte = *(*pNext)++;
+    value |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  return value;
+}
+
+static const unsigned char *getTimes (const unsigned char *pNext, const unsigned char *pEnd, archiveDayStruct *pDays, unsigned int pCount, boolean pRise)
+{
+  int64_t previous = 0, delta = 0;
+  unsigned int normal = 0;
+  for (unsigned int i=0; i < pCount; i++)
+  { if (pDays[i].dayType != DAYTYPE_NORMAL) continue;
+    int64_t value;
+    if (normal == 0)      value = unzigzag (getVarint (&pNext, pEnd));
+    else if (normal == 1) value = previous + unzigzag (getVarint (&pNext, pEnd));
+    else                  value = previous + delta + unzigzag (getVarint (&pNext, pEnd));
+    if (normal > 0) delta = value - previous;
+    previous = value;
+    normal++;
+    if (pRise) pDays[i].rise = (int32_t) value;
+    else       pDays[i].set  = (int32_t) value;
+  }
+  return pNext;
+}
+
+/* One block's days into pDays, which has room for a whole block */
+static boolean getBlock (const archiveStruct *pArchive, size_t pSite, unsigned int pBlock, archiveDayStruct *pDays, unsigned int *pCount)
+{
+  const archiveHeader     *header = pArchive->header;
+  const archiveSiteRecord *site   = &pArchive->sites[pSite];
+  const unsigned char *data = (const unsigned char *) pArchive->data + site->dataOffset;
+  const unsigned char *end  = data + site->dataSize;
+
+  uint32_t offset;
+  if ((pBlock + 1) * sizeof (uint32_t) > site->dataSize) return false;
+  memcpy (&offset, data + pBlock * sizeof (uint32_t), sizeof (offset));
+  if (offset >= site->dataSize) return false;
+
+  unsigned int first = pBlock * header->blockDays;
+  unsigned int count = header->days - first < header->blockDays ? header->days - first : header->blockDays;
+  const unsigned char *next = data + offset;
+
+  uint64_t runs = getVarint (&next, end);
+  unsigned int day = 0;
+  for (uint64_t run=0; run < runs && next < end; run++)
+  { DayType  type   = (DayType) *next++;
+    uint64_t length = getVarint (&next, end);
+    for (uint64_t i=0; i < length && day < count; i++, day++) { pDays[day].dayType = type; pDays[day].rise = pDays[day].set = 0; }
+  }
+  if (day != count) return false;
+
+  next = getTimes (next, end, pDays, count, true);
+  getTimes (next, end, pDays, count, false);
+  *pCount = count;
+  return true;
+}
+
+boolean archive_decode (const archiveStruct *pArchive, size_t pSite, long long pDay, unsigned int pDays, archiveDayStruct *pOut)
+{
+  const archiveHeader *header = pArchive->header;
+  if (pSite >= header->siteCount || pDay < header->firstDay || pDay + pDays > header->firstDay + header->days) return false;
+
+  std::vector<archiveDayStruct> block (header->blockDays);
+  unsigned int day = pDay - header->firstDay, done = 0;
+  while (done < pDays)
+  { unsigned int count;
+    if (!getBlock (pArchive, pSite, day / header->blockDays, block.data (), &count)) return false;
+    unsigned int from = day % header->blockDays;
+    unsigned int take = count - from < pDays - done ? count - from : pDays - done;
+    memcpy (pOut + done, &block[from], take * sizeof (archiveDayStruct));
+    done += take;
+    day  += take;
+  }
+  return true;
+}
+
+boolean print_archive (targetStruct *pTarget, const char *pFileName, unsigned int pDays)
+{
+  archiveStruct archive;
+  if (!archive_open (pFileName, &archive)) return false;
+  const archiveHeader *header = archive.header;
+
+  /* Everything, or 'X' days from the target date */
+  long long first = header->firstDay;
+  unsigned int days = header->days;
+  if (pDays > 0)
+  { first = pTarget->daysSince2000;
+    days  = pDays;
+    if (first < header->firstDay || first + days > header->firstDay + header->days)
+    { printf ("Error: Days outside the archive, which holds %u days from day %lld.\n", header->days, (long long) header->firstDay);
+      archive_close (&archive);
+      return false;
+    }
+  }
+
+  targetStruct target = *pTarget;
+  target.twilightAngle = header->twilightAngle;
+  target.hourOffset    = header->hourOffset;
+
+  std::vector<archiveDayStruct> decoded (days);
+  std::string output;
+  std::chrono::duration<double> decoding (0);
+  boolean damaged = false;
+  for (size_t i=0; i < header->siteCount; i++)
+  { const archiveSiteRecord *record = &archive.sites[i];
+    siteStruct site;
+    site.name       = archive.data + header->namesOffset + record->nameOffset;
+    site.nameLength = record->nameLength;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    boolean ok = archive_decode (&archive, i, first, days, decoded.data ());
+    decoding += std::chrono::steady_clock::now () - start;
+    if (!ok)
+    { printf ("Error: Damaged archive data for site %.*s\n", (int) site.nameLength, site.name);
+      damaged = true;
+      continue;
+    }
+
+    output.clear ();
+    target.daysSince2000 = first;
+    for (unsigned int day=0; day < days; day++, target.daysSince2000++)
+    { civilFromDaysSince2000 (target.daysSince2000, &target.year, &target.month, &target.dayOfMonth);
+      append_site (&output, &site);
+      output.push_back (',');
+      append_date (&output, &target);
+      if (decoded[day].dayType == DAYTYPE_NORMAL)
+      { /* Mid-second, so the truncated minutes match those of the exact times */
+        target.riseTime = (decoded[day].rise + 0.5) / 3600.0;
+        target.setTime  = (decoded[day].set  + 0.5) / 3600.0;
+        output.push_back (',');
+        append_time (&output, getOffsetRiseTime (&target));
+        output.push_back (',');
+        append_time (&output, getOffsetSetTime (&target));
+        output.append (",normal\n");
+      }
+      else if (decoded[day].dayType == DAYTYPE_POLAR_DAY)
+        output.append (",--:--,--:--,polar-day\n");
+      else
+        output.append (",--:--,--:--,polar-night\n");
+    }
+    fwrite (output.data (), 1, output.size (), stdout);
+  }
+  boolean written = fflush (stdout) == 0 && !ferror (stdout);
+
+  if (pTarget->debug == ONOFF_ON)
+  { double siteDays = (double) header->siteCount * days;
+    printf ( "Debug: Unarchive - %.0f site-days decoded in %.3f seconds, %.0f per second.\n"
+           , siteDays, decoding.count (), siteDays / fmax (decoding.count (), 1e-9));
+  }
+  archive_close (&archive);
+  return written && !damaged;
+}
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include "sunwait.h"
+
+#ifndef ARCHIVE_H
+  #define ARCHIVE_H
+
+/*
+** Compressed rise/set archive. Per site, days are cut into blocks of ARCHIVE_BLOCK_DAYS, each
+** decodable on its own through the site's block offset table:
+**
+**   day types  run-length: varint run count, then (type byte, varint length) per run
+**   rise, set  over the block's normal days, whole seconds (truncated) from the day's 00:00 GMT:
+**              first value, then first difference, then differences of differences,
+**              each zigzag-mapped and written as a varint
+**
+** File: header, each site's block offsets and blocks, the site directory, the site names.
+*/
+#define ARCHIVE_MAGIC      "SWA1"
+#define ARCHIVE_BLOCK_DAYS 64
+
+typedef struct
+{
+  char     magic[4];
+  uint32_t blockDays;
+  int64_t  firstDay;         // Days since 2000 of the first day archived
+  uint32_t days;
+  uint32_t reserved;
+  uint64_t siteCount;
+  uint64_t directoryOffset;
+  uint64_t namesOffset;
+  double   twilightAngle;
+  double   hourOffset;
+} archiveHeader;
+
+typedef struct
+{
+  double   latitude;
+  double   longitude;
+  uint64_t dataOffset;       // Block offsets, then blocks
+  uint64_t nameOffset;       // From the start of the names
+  uint32_t dataSize;
+  uint32_t nameLength;
+} archiveSiteRecord;
+
+typedef struct
+{
+  DayType dayType;
+  int32_t rise;              // Seconds from 00:00 GMT. Normal days only
+  int32_t set;
+} archiveDayStruct;
+
+typedef struct
+{
+  const char              *data;    // Mapped file
+  size_t                   size;
+  const archiveHeader     *header;
+  const archiveSiteRecord *sites;
+} archiveStruct;
+
+boolean archive_open  (const char *pFileName, archiveStruct *pArchive);
+void    archive_close (archiveStruct *pArchive);
+
+/* Decode pDays days of a site from day pDay (days since 2000), starting at the block holding it */
+boolean archive_decode (const archiveStruct *pArchive, size_t pSite, long long pDay, unsigned int pDays, archiveDayStruct *pOut);
+
+/* 'archive FILE': the target's sites for the 'list' days from the target date. False on failure */
+boolean write_archive (targetStruct *pTarget, const char *pFileName);
+
+/*
+** 'unarchive FILE [X]': table rows for all days, or 'X' days from the target date. False if the
+** archive could not be read, any site's data was damaged, or the output could not be written.
+*/
+boolean print_archive (targetStruct *pTarget, const char *pFileName, unsigned int pDays);
+
+#endif
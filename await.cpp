@@ -0,0 +1,277 @@
+/*
+** await.cpp - timer backends and awaitable events for the coroutine API
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "clock.h"
+#include "sites.h"
+#include "table.h"
+#include "await.h"
+
+namespace sunwait
+{
+
+/*
+** >>>>> Deadlines <<<<<
+*/
+
+void next_event (const targetStruct *pTarget, double pAfter, eventStruct *pEvent)
+{
+  targetStruct target = *pTarget;
+  setNowTime (&target, pAfter);
+  long long today  = daysSince2000 (target.nowYear, target.nowMonth, target.nowDayOfMonth);
+  double dayStart  = (today + DAYS_2000_JAN_0) * 86400.0;
+
+  pEvent->found = false;
+  for (int day=0; day <= 400; day++)
+  {
+    target.daysSince2000 = today + day;
+    civilFromDaysSince2000 (target.daysSince2000, &target.year, &target.month, &target.dayOfMonth);
+    sunriset (&target);
+    if (target.dayType != DAYTYPE_NORMAL) continue;
+
+    /* As 'stream' next: the earlier of rise and set, unless only one was asked for */
+    double rise = getOffsetRiseTime (&target) + day * 24.0;
+    double set  = getOffsetSetTime  (&target) + day * 24.0;
+    boolean useRise = target.upDown != UPDOWN_SUNSET  && rise > target.nowTime;
+    boolean useSet  = target.upDown != UPDOWN_SUNRISE && set  > target.nowTime;
+    if (useRise || useSet)
+    { boolean isRise = useRise && (!useSet || rise < set);
+      pEvent->found = true;
+      pEvent->event = isRise ? UPDOWN_SUNRISE : UPDOWN_SUNSET;
+      pEvent->time  = dayStart + (isRise ? rise : set) * 3600.0;
+      return;
+    }
+  }
+}
+
+eventAwaitable::eventAwaitable (const targetStruct *pTarget, double pAfter, timerBackend *pBackend)
+{
+  backend = pBackend ? pBackend : default_backend ();
+  next_event (pTarget, pAfter, &event);
+}
+
+bool eventAwaitable::await_ready () const
+{
+  return !event.found || event.time <= clock_now ();
+}
+
+eventAwaitable next (const targetStruct &pTarget, timerBackend *pBackend)
+{
+  return eventAwaitable (&pTarget, clock_now (), pBackend);
+}
+
+eventAwaitable next (const targetStruct &pTarget, double pAfter, timerBackend *pBackend)
+{
+  return eventAwaitable (&pTarget, pAfter, pBackend);
+}
+
+eventAwaitable next (const siteStruct &pSite, double pAngle, UpDown pUpDown, timerBackend *pBackend)
+{
+  targetStruct target;
+  memset (&target, 0, sizeof (target));
+  target.latitude      = pSite.latitude;
+  target.longitude     = pSite.longitude;
+  target.twilightAngle = pAngle;
+  target.upDown        = pUpDown;
+  target.function      = FUNCTION_WAIT;
+  target.report        = ONOFF_OFF;
+  target.debug         = ONOFF_OFF;
+  target.exitReport    = ONOFF_OFF;
+  target.binary        = ONOFF_OFF;
+  target.simulate      = ONOFF_OFF;
+  target.refine        = ONOFF_OFF;
+  target.refineSeeded  = ONOFF_OFF;
+  target.engine        = pSite.engine == ENGINE_NOT_SET ? ENGINE_FAST : pSite.engine;
+  return eventAwaitable (&target, clock_now (), pBackend);
+}
+
+/*
+** >>>>> Backends <<<<<
+*/
+
+epollTimerBackend::epollTimerBackend ()
+{
+  epollFd = epoll_create1 (EPOLL_CLOEXEC);
+  timerFd = timerfd_create (CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (epollFd < 0 || timerFd < 0)
+  { printf ("Error: Unable to create timer: %s\n", strerror (errno));
+    exit (EXIT_ERROR);
+  }
+
+  struct epoll_event event;
+  memset (&event, 0, sizeof (event));
+  event.events = EPOLLIN;
+  epoll_ctl (epollFd, EPOLL_CTL_ADD, timerFd, &event);
+}
+
+epollTimerBackend::~epollTimerBackend ()
+{
+  close (timerFd);
+  close (epollFd);
+}
+
+/* Absolute expiry at the earliest deadline, or disarmed if there is none */
+void epollTimerBackend::arm ()
+{
+  struct itimerspec spec;
+  memset (&spec, 0, sizeof (spec));
+  if (!heap.empty ())
+  { double deadline = fmax (heap.top ().first, 1e-9);   /* All zero would disarm */
+    spec.it_value.tv_sec  = (time_t) floor (deadline);
+    spec.it_value.tv_nsec = (long) ((deadline - floor (deadline)) * 1e9);
+  }
+  timerfd_settime (timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void epollTimerBackend::schedule (double pDeadline, std::coroutine_handle<> pHandle)
+{
+  boolean earliest = heap.empty () || pDeadline < heap.top ().first;
+  heap.push (timerEntry (pDeadline, pHandle));
+  if (earliest) arm ();
+}
+
+void epollTimerBackend::dispatch ()
+{
+  unsigned long long expirations;
+  while (read (timerFd, &expirations, sizeof (expirations)) > 0) {}
+
+  double now = clock_now ();
+  while (!heap.empty () && heap.top ().first <= now)
+  { std::coroutine_handle<> handle = heap.top ().second;
+    heap.pop ();
+    handle.resume ();   /* May schedule again */
+  }
+  arm ();
+}
+
+void epollTimerBackend::run ()
+{
+  while (!heap.empty ())
+  { struct epoll_event event;
+    int ready = epoll_wait (epollFd, &event, 1, -1);
+    if (ready < 0 && errno != EINTR)
+    { printf ("Error: Timer wait failed: %s\n", strerror (errno));
+      return;
+    }
+    dispatch ();
+  }
+}
+
+void clockTimerBackend::run ()
+{
+  while (!heap.empty ())
+  { double wait = heap.top ().first - clock_now ();
+    if (wait > 0) clock_sleep (wait);
+    std::coroutine_handle<> handle = heap.top ().second;
+    heap.pop ();
+    handle.resume ();
+  }
+}
+
+timerBackend *default_backend ()
+{
+  static epollTimerBackend backend;
+  return &backend;
+}
+
+/*
+** >>>>> Coroutine frames <<<<<
+*/
+
+static std::atomic<size_t> sFrameBytes (0);
+
+void *task::promise_type::operator new (size_t pSize)
+{
+  void *frame = malloc (pSize);
+  if (!frame) throw std::bad_alloc ();
+  sFrameBytes += pSize;
+  return frame;
+}
+
+void task::promise_type::operator delete (void *pFrame, size_t pSize)
+{
+  sFrameBytes -= pSize;
+  free (pFrame);
+}
+
+size_t frame_bytes ()
+{
+  return sFrameBytes;
+}
+
+}
+
+/*
+** >>>>> 'wait' for every site <<<<<
+*/
+
+/* The site's next event. A plain function, so its target copy is not kept in the coroutine frame */
+static sunwait::eventAwaitable nextForSite (const targetStruct *pDefaults, const siteStruct *pSite, double pAfter, sunwait::timerBackend *pBackend)
+{
+  targetStruct target = *pDefaults;
+  target.latitude  = pSite->latitude;
+  target.longitude = pSite->longitude;
+  if (pSite->engine != ENGINE_NOT_SET) target.engine = pSite->engine;
+  return sunwait::next (target, pAfter, pBackend);
+}
+
+static void printEvent (const siteStruct *pSite, const sunwait::eventStruct *pEvent)
+{
+  char iso[32];
+  long long days = (long long) floor (pEvent->time / 86400.0);
+  formatIsoTime (iso, sizeof (iso), days, (pEvent->time - days * 86400.0) / 3600.0);
+  std::string row (iso);
+  row.push_back (',');
+  append_site (&row, pSite);
+  row.append (pEvent->event == UPDOWN_SUNRISE ? ",rise\n" : ",set\n");
+  fwrite (row.data (), 1, row.size (), stdout);
+}
+
+static sunwait::task awaitSite (const targetStruct *pDefaults, const siteStruct *pSite, sunwait::timerBackend *pBackend)
+{
+  /* As the simulated 'wait', look again from one second after each event */
+  double after = clock_now ();
+  do
+  { sunwait::eventStruct event = co_await nextForSite (pDefaults, pSite, after, pBackend);
+    if (!event.found || (pDefaults->simulate == ONOFF_ON && event.time >= pDefaults->simulateTo)) break;
+    printEvent (pSite, &event);
+    after = event.time + 1.0;
+  } while (pDefaults->simulate == ONOFF_ON);
+}
+
+void run_await (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return;
+
+  sunwait::clockTimerBackend clockBackend;
+  sunwait::timerBackend *backend = sunwait::default_backend ();
+  if (pTarget->simulate == ONOFF_ON)
+  { clock_virtual (pTarget->simulateFrom, pTarget->speed);
+    backend = &clockBackend;
+  }
+
+  for (size_t i=0; i < sites.count; i++) awaitSite (pTarget, &sites.sites[i], backend);
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Await - %lu waits pending, %lu bytes of coroutine frames.\n"
+           , (unsigned long) backend->pending (), (unsigned long) sunwait::frame_bytes ());
+
+  backend->run ();
+  fflush (stdout);
+  if (pTarget->simulate == ONOFF_ON) clock_install (NULL);
+  free_sites (&sites);
+}
@@ -0,0 +1,124 @@
+#include <coroutine>
+#include <exception>
+#include <queue>
+#include <vector>
+#include "sunwait.h"
+#include "sites.h"
+
+#ifndef AWAIT_H
+  #define AWAIT_H
+
+/*
+** Awaitable solar events, for services running their own event loop:
+**
+**   sunwait::task watch (siteStruct site)
+**   { sunwait::eventStruct event = co_await sunwait::next (site, TWILIGHT_ANGLE_CIVIL, UPDOWN_SUNSET);
+**     ...
+**   }
+**
+** The deadline comes from sunriset() and getOffsetRiseTime()/getOffsetSetTime(), as for 'wait'.
+** A suspended wait is a coroutine frame plus one timer heap entry, not a thread.
+*/
+namespace sunwait
+{
+  typedef struct
+  {
+    boolean found;     // false: no such event within 400 days
+    UpDown  event;     // UPDOWN_SUNRISE or UPDOWN_SUNSET
+    double  time;      // Seconds since 1970 UTC
+  } eventStruct;
+
+  /* Where suspended waits are parked until their deadlines */
+  class timerBackend
+  {
+  public:
+    virtual ~timerBackend () {}
+    virtual void   schedule (double pDeadline, std::coroutine_handle<> pHandle) = 0;
+    virtual size_t pending  () const = 0;
+    virtual void   run      () = 0;   // Resume waits as their deadlines pass, until none are left
+  };
+
+  typedef std::pair<double, std::coroutine_handle<> > timerEntry;
+  typedef std::priority_queue<timerEntry, std::vector<timerEntry>, std::greater<timerEntry> > timerHeap;
+
+  /*
+  ** Default backend: a min-heap of deadlines and one timerfd, armed for the earliest, in an epoll
+  ** set. To embed in another loop, watch fd() for input and call dispatch() when it is ready.
+  */
+  class epollTimerBackend : public timerBackend
+  {
+  public:
+    epollTimerBackend ();
+    ~epollTimerBackend ();
+    void   schedule (double pDeadline, std::coroutine_handle<> pHandle);
+    size_t pending  () const { return heap.size (); }
+    void   run      ();
+    int    fd       () const { return epollFd; }
+    void   dispatch ();       // Resume every wait whose deadline has passed
+  private:
+    void   arm      ();
+    timerHeap heap;
+    int       epollFd;
+    int       timerFd;
+  };
+
+  /* Portable backend sleeping on clock.h's clock, so it also runs on the simulation's virtual clock */
+  class clockTimerBackend : public timerBackend
+  {
+  public:
+    void   schedule (double pDeadline, std::coroutine_handle<> pHandle) { heap.push (timerEntry (pDeadline, pHandle)); }
+    size_t pending  () const { return heap.size (); }
+    void   run      ();
+  private:
+    timerHeap heap;
+  };
+
+  /* The epoll backend, created on first use */
+  timerBackend *default_backend ();
+
+  /* Next event after pAfter (seconds since 1970) for the target's location, twilight angle, offset and rise/set */
+  void next_event (const targetStruct *pTarget, double pAfter, eventStruct *pEvent);
+
+  class eventAwaitable
+  {
+  public:
+    eventAwaitable (const targetStruct *pTarget, double pAfter, timerBackend *pBackend);
+    bool        await_ready   () const;
+    void        await_suspend (std::coroutine_handle<> pHandle) { backend->schedule (event.time, pHandle); }
+    eventStruct await_resume  () const { return event; }
+  private:
+    eventStruct   event;
+    timerBackend *backend;
+  };
+
+  /* Next event after now, or after pAfter. pBackend NULL: default_backend() */
+  eventAwaitable next (const targetStruct &pTarget, timerBackend *pBackend = NULL);
+  eventAwaitable next (const targetStruct &pTarget, double pAfter, timerBackend *pBackend = NULL);
+  eventAwaitable next (const siteStruct &pSite, double pAngle, UpDown pUpDown, timerBackend *pBackend = NULL);
+
+  /* Coroutine frames allocated by task, for the debug report */
+  size_t frame_bytes ();
+
+  /* Fire-and-forget coroutine: runs until its first co_await, and frees itself when it returns */
+  struct task
+  {
+    struct promise_type
+    {
+      task                get_return_object   () { return task (); }
+      std::suspend_never  initial_suspend     () { return {}; }
+      std::suspend_never  final_suspend       () noexcept { return {}; }
+      void                return_void         () {}
+      void                unhandled_exception () { std::terminate (); }
+      static void        *operator new    (size_t pSize);
+      static void         operator delete (void *pFrame, size_t pSize);
+    };
+  };
+}
+
+/*
+** 'wait' with a site file: one coroutine per site, each printing "time,site,rise|set" when its
+** event fires. With 'simulate', on the virtual clock, each keeps waiting until the end time.
+*/
+void run_await (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+** bench.cpp - compares the solar engines
+**
+** Both engines run single-threaded over the same site-days, so the throughput figures compare
+** the algorithms rather than the pool. The NOAA engine is taken as the reference for errors.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+#include "table.h"
+#include "bench.h"
+
+/* Without a site file: every 5 degrees of latitude to 60N/S, every 15 degrees of longitude */
+#define BENCH_GRID_LATITUDE  5
+#define BENCH_GRID_LONGITUDE 15
+
+typedef struct
+{
+  double  rise;
+  double  set;
+  DayType dayType;
+} benchResultStruct;
+
+static void gridSites (siteListStruct *pSites)
+{
+  memset (pSites, 0, sizeof (*pSites));
+  pSites->sites = (siteStruct *) malloc ((120 / BENCH_GRID_LATITUDE + 1) * (360 / BENCH_GRID_LONGITUDE) * sizeof (siteStruct));
+  if (!pSites->sites) return;
+
+  for (int latitude = -60; latitude <= 60; latitude += BENCH_GRID_LATITUDE)
+    for (int longitude = 0; longitude < 360; longitude += BENCH_GRID_LONGITUDE)
+    { siteStruct *site = &pSites->sites[pSites->count++];
+      site->name       = "grid";
+      site->nameLength = 4;
+      site->latitude   = revolution (latitude);
+      site->longitude  = longitude;
+      site->engine     = ENGINE_NOT_SET;
+    }
+}
+
+/* Seconds between two times of day, allowing for one engine's event falling on the other side of midnight */
+static double difference (double pA, double pB)
+{
+  double hours = fabs (pA - pB);
+  if (hours > 12.0) hours = 24.0 - hours;
+  return hours * 3600.0;
+}
+
+/* Seconds to compute every site-day with pEngine, results in site, then day, order */
+static double runEngine (const targetStruct *pTarget, const siteListStruct *pSites, unsigned int pDays, Engine pEngine, OnOff pRefine, std::vector<benchResultStruct> *pResults)
+{
+  pResults->resize (pSites->count * pDays);
+  benchResultStruct *result = pResults->data ();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  for (size_t i=0; i < pSites->count; i++)
+  { targetStruct target = *pTarget;
+    target.latitude  = pSites->sites[i].latitude;
+    target.longitude = pSites->sites[i].longitude;
+    target.engine    = pEngine;
+    target.refine    = pRefine;
+    for (unsigned int day=0; day < pDays; day++, result++)
+    { target.daysSince2000 = pTarget->daysSince2000 + day;
+      sunriset (&target);
+      result->rise    = target.riseTime;
+      result->set     = target.setTime;
+      result->dayType = target.dayType;
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+  return elapsed.count ();
+}
+
+/* Rise and set errors of pResults against the reference */
+static void printErrors (const char *pName, const std::vector<benchResultStruct> *pResults, const std::vector<benchResultStruct> *pReference)
+{
+  /* Only days both engines call normal have times to compare */
+  double riseTotal = 0.0, riseMax = 0.0, setTotal = 0.0, setMax = 0.0;
+  size_t compared = 0, mismatched = 0;
+  for (size_t i=0; i < pResults->size (); i++)
+  { const benchResultStruct *result = &(*pResults)[i], *reference = &(*pReference)[i];
+    if (result->dayType != reference->dayType) { mismatched++; continue; }
+    if (result->dayType != DAYTYPE_NORMAL) continue;
+    double rise = difference (result->rise, reference->rise);
+    double set  = difference (result->set,  reference->set);
+    riseTotal += rise; if (rise > riseMax) riseMax = rise;
+    setTotal  += set;  if (set  > setMax)  setMax  = set;
+    compared++;
+  }
+
+  if (compared > 0)
+    printf ( "%s vs noaa: rise mean %.1f, max %.1f seconds; set mean %.1f, max %.1f seconds; %lu days.\n"
+           , pName, riseTotal / compared, riseMax, setTotal / compared, setMax, (unsigned long) compared);
+  printf ("%s vs noaa: %lu days of different day type (polar day/night).\n", pName, (unsigned long) mismatched);
+}
+
+void print_bench (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (pTarget->siteFile) { if (!load_sites (pTarget->siteFile, &sites)) return; }
+  else gridSites (&sites);
+
+  unsigned int days = pTarget->list > 0 ? pTarget->list : 365;
+  double siteDays = (double) sites.count * days;
+  if (siteDays == 0) { free_sites (&sites); return; }
+
+  std::vector<benchResultStruct> fast, refined, noaa;
+  double fastSeconds    = runEngine (pTarget, &sites, days, ENGINE_FAST, ONOFF_OFF, &fast);
+  double refinedSeconds = runEngine (pTarget, &sites, days, ENGINE_FAST, ONOFF_ON,  &refined);
+  double noaaSeconds    = runEngine (pTarget, &sites, days, ENGINE_NOAA, ONOFF_OFF, &noaa);
+
+  printf ("Engine fast:   %.0f site-days in %.3f seconds, %.0f per second.\n", siteDays, fastSeconds,    siteDays / fmax (fastSeconds, 1e-9));
+  printf ("Engine refine: %.0f site-days in %.3f seconds, %.0f per second.\n", siteDays, refinedSeconds, siteDays / fmax (refinedSeconds, 1e-9));
+  printf ("Engine noaa:   %.0f site-days in %.3f seconds, %.0f per second.\n", siteDays, noaaSeconds,    siteDays / fmax (noaaSeconds, 1e-9));
+  printErrors ("fast",   &fast,    &noaa);
+  printErrors ("refine", &refined, &noaa);
+
+  free_sites (&sites);
+}
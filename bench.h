@@ -0,0 +1,13 @@
+#include "sunwait.h"
+
+#ifndef BENCH_H
+  #define BENCH_H
+
+/*
+** Time each engine over the sites (or a world grid of sites) for the target's list of days,
+** then report how far the fast engine's rise and set times, plain and refined, are from the
+** precise engine's.
+*/
+void print_bench (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+** cellcache.cpp - sharded LRU cache of interpolated rise/set cells
+**
+** Error bound: the fast engine uses one ephemeris for the day, so transit is linear in longitude
+** and the diurnal arc w depends only on latitude. Rise and set are transit -/+ w, and bilinear
+** interpolation is exact for the linear part; along latitude its error is at most h^2/8 times
+** the largest |w''| over the cell, h the cell's height. With c = (sin(alt) - sin(lat)sin(dec)) /
+** (cos(lat)cos(dec)) and w = acos(c):
+**
+**   w'' = -c''/sqrt(1-c^2) - c*c'^2/(1-c^2)^(3/2)
+**
+** c, c' and c'' are bounded over the cell from the ranges of sec(lat) and tan(lat), which are
+** monotonic in |lat| and lat. A cell is used only if that bound is within the allowed error.
+** Where there is no bound - the NOAA engine, refined events, a cell reaching polar day or night,
+** or transit wrapping across the cell - every point is computed exactly.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "cellcache.h"
+
+#define CELLCACHE_SHARDS   16      /* Power of two */
+#define CELLCACHE_CAPACITY 65536   /* Cells, across all shards */
+
+typedef struct
+{
+  long long days;
+  double    angle;
+  int       latitudeCell;
+  int       longitudeCell;
+  int       engine;
+  int       refine;
+} cellKeyStruct;
+
+typedef struct
+{
+  cellKeyStruct key;
+  boolean exact;        /* Failed the error check: compute points in this cell directly */
+  DayType dayType;      /* Common to all four corners */
+  double  rise[4];      /* Corners: (lat0,lon0), (lat0,lon1), (lat1,lon0), (lat1,lon1) */
+  double  noon[4];
+  double  set[4];
+} cellStruct;
+
+struct cellKeyHash
+{
+  size_t operator() (const cellKeyStruct &pKey) const
+  { /* FNV-1a over the fields */
+    unsigned long long hash = 14695981039346656037ULL;
+    const unsigned char *bytes = (const unsigned char *) &pKey.days;
+    for (size_t i=0; i < sizeof (pKey.days); i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    bytes = (const unsigned char *) &pKey.angle;
+    for (size_t i=0; i < sizeof (pKey.angle); i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    hash = (hash ^ (unsigned) pKey.latitudeCell)  * 1099511628211ULL;
+    hash = (hash ^ (unsigned) pKey.longitudeCell) * 1099511628211ULL;
+    hash = (hash ^ (unsigned) (pKey.engine * 2 + pKey.refine)) * 1099511628211ULL;
+    return (size_t) hash;
+  }
+};
+
+struct cellKeyEqual
+{
+  bool operator() (const cellKeyStruct &pA, const cellKeyStruct &pB) const
+  { return pA.days == pB.days && pA.angle == pB.angle
+        && pA.latitudeCell == pB.latitudeCell && pA.longitudeCell == pB.longitudeCell
+        && pA.engine == pB.engine && pA.refine == pB.refine;
+  }
+};
+
+/* Most recently used at the front of the list */
+typedef struct
+{
+  std::mutex            mutex;
+  std::list<cellStruct> cells;
+  std::unordered_map<cellKeyStruct, std::list<cellStruct>::iterator, cellKeyHash, cellKeyEqual> index;
+} cellShardStruct;
+
+struct cellCacheStruct
+{
+  double cellDegrees;
+  double maxErrorHours;
+  size_t shardCapacity;
+  cellShardStruct shards[CELLCACHE_SHARDS];
+  std::atomic<unsigned long long> hits;
+  std::atomic<unsigned long long> misses;
+  std::atomic<unsigned long long> exact;   /* Queries answered exactly, in cells failing the check */
+};
+
+cellCacheStruct *cellcache_create (double pCellDegrees, double pMaxErrorSeconds)
+{
+  cellCacheStruct *cache = new cellCacheStruct;
+  cache->cellDegrees   = pCellDegrees;
+  cache->maxErrorHours = pMaxErrorSeconds / 3600.0;
+  cache->shardCapacity = CELLCACHE_CAPACITY / CELLCACHE_SHARDS;
+  cache->hits   = 0;
+  cache->misses = 0;
+  cache->exact  = 0;
+  return cache;
+}
+
+void cellcache_settings (const cellCacheStruct *pCache, double *pCellDegrees, double *pMaxErrorSeconds)
+{
+  *pCellDegrees     = pCache->cellDegrees;
+  *pMaxErrorSeconds = pCache->maxErrorHours * 3600.0;
+}
+
+void cellcache_free (cellCacheStruct *pCache)
+{
+  delete pCache;
+}
+
+/* Exact result at a point, bypassing the cache */
+static void exactSunriset (const targetStruct *pTarget, const ephemerisStruct *pEphemeris, double pLatitude, double pLongitude, targetStruct *pResult)
+{
+  *pResult = *pTarget;
+  pResult->cache     = NULL;
+  pResult->latitude  = pLatitude;
+  pResult->longitude = pLongitude;
+  if (pEphemeris) sunriset_ephemeris (pResult, pEphemeris);
+  else            sunriset (pResult);
+}
+
+static double interpolate (const double pCorner[4], double pU, double pV)
+{
+  return (1.0 - pU) * ((1.0 - pV) * pCorner[0] + pV * pCorner[1])
+       +        pU  * ((1.0 - pV) * pCorner[2] + pV * pCorner[3]);
+}
+
+/*
+** Range of c across latitudes [pLatitude0, pLatitude1], and a bound, hours, on the error of
+** interpolating the fast engine's diurnal arc across them: HUGE_VAL if c reaches +/-1 between.
+*/
+static double arcErrorBound (double pLatitude0, double pLatitude1, double pAltit, double pDeclination, double *pCLow, double *pCHigh)
+{
+  double x0 = pLatitude0 / RADIAN_TO_DEGREE, x1 = pLatitude1 / RADIAN_TO_DEGREE;
+  *pCLow  = -HUGE_VAL;
+  *pCHigh =  HUGE_VAL;
+  if (fabs (x0) >= 0.5 * PI - 1e-6 || fabs (x1) >= 0.5 * PI - 1e-6) return HUGE_VAL;
+
+  double secMax = 1.0 / cos (fmax (fabs (x0), fabs (x1)));
+  double secMin = (x0 <= 0.0 && x1 >= 0.0) ? 1.0 : 1.0 / cos (fmin (fabs (x0), fabs (x1)));
+  double tanLow = tan (x0), tanHigh = tan (x1), tanMax = fmax (fabs (tanLow), fabs (tanHigh));
+  double a = sind (pAltit) / cosd (pDeclination), s = tand (pDeclination);
+
+  /* c = a*sec - s*tan: each term's range, then the sum's */
+  double aSecLow  = fmin (a * secMin, a * secMax), aSecHigh = fmax (a * secMin, a * secMax);
+  double sTanLow  = fmin (s * tanLow, s * tanHigh), sTanHigh = fmax (s * tanLow, s * tanHigh);
+  *pCLow  = aSecLow  - sTanHigh;
+  *pCHigh = aSecHigh - sTanLow;
+  double cMax = fmax (fabs (*pCLow), fabs (*pCHigh));
+  if (cMax >= 1.0) return HUGE_VAL;
+
+  /* c' = a*sec*tan - s*sec^2,  c'' = a*(sec*tan^2 + sec^3) - 2*s*sec^2*tan */
+  double d1 = fabs (a) * secMax * tanMax + fabs (s) * secMax * secMax;
+  double d2 = fabs (a) * (secMax * tanMax * tanMax + secMax * secMax * secMax) + 2.0 * fabs (s) * secMax * secMax * tanMax;
+  double q  = 1.0 - cMax * cMax;
+  double curvature = d2 / sqrt (q) + cMax * d1 * d1 / (q * sqrt (q));
+
+  double h = x1 - x0;
+  return h * h / 8.0 * curvature * RADIAN_TO_DEGREE / 15.0;
+}
+
+static void buildCell (cellCacheStruct *pCache, const targetStruct *pTarget, const ephemerisStruct *pEphemeris, cellStruct *pCell)
+{
+  double size       = pCache->cellDegrees;
+  double latitude0  = pCell->key.latitudeCell  * size;
+  double longitude0 = pCell->key.longitudeCell * size;
+
+  pCell->exact   = false;
+  pCell->dayType = DAYTYPE_NORMAL;
+  for (int corner=0; corner < 4; corner++)
+  { targetStruct result;
+    exactSunriset (pTarget, pEphemeris, latitude0 + (corner >> 1) * size, longitude0 + (corner & 1) * size, &result);
+    if (corner == 0) pCell->dayType = result.dayType;
+    else if (result.dayType != pCell->dayType) pCell->exact = true;
+    pCell->rise[corner] = result.riseTime;
+    pCell->noon[corner] = result.noonTime;
+    pCell->set[corner]  = result.setTime;
+  }
+  if (pCell->exact) return;
+
+  /* Transit must fall the cell's width apart, not across the wrap of the day */
+  double width = size / 15.0;
+  if ( fabs (pCell->noon[0] - pCell->noon[1] - width) > 1e-9 || fabs (pCell->noon[2] - pCell->noon[3] - width) > 1e-9
+    || fabs (pCell->noon[0] - pCell->noon[2]) > 1e-9)
+  { pCell->exact = true;
+    return;
+  }
+
+  /* The arc's altitude and declination, as sunriset_ephemeris() has them */
+  ephemerisStruct ephemeris;
+  if (pEphemeris) ephemeris = *pEphemeris;
+  else            sun_ephemeris (pTarget->daysSince2000, &ephemeris);
+  double altit = pTarget->twilightAngle;
+  if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altit -= 0.2666 / ephemeris.sr;
+
+  double cLow, cHigh;
+  double bound = arcErrorBound (latitude0, latitude0 + size, altit, ephemeris.sdec, &cLow, &cHigh);
+
+  /* Polar day or night must hold across the whole cell, rise and set must be within the bound */
+  if      (pCell->dayType == DAYTYPE_POLAR_NIGHT) pCell->exact = cLow  < 1.0;
+  else if (pCell->dayType == DAYTYPE_POLAR_DAY)   pCell->exact = cHigh > -1.0;
+  else                                            pCell->exact = bound > pCache->maxErrorHours;
+}
+
+void cellcache_sunriset (targetStruct *pTarget, const ephemerisStruct *pEphemeris)
+{
+  cellCacheStruct *cache = pTarget->cache;
+
+  /* The skyline depends on the exact location, and only the fast engine's error is bounded */
+  if (pTarget->horizon || pTarget->engine != ENGINE_FAST || pTarget->refine == ONOFF_ON)
+  { pTarget->cache = NULL;
+    if (pEphemeris) sunriset_ephemeris (pTarget, pEphemeris);
+    else            sunriset (pTarget);
+    pTarget->cache = cache;
+    cache->exact++;
+    return;
+  }
+
+  cellStruct cell;
+  memset (&cell, 0, sizeof (cell));
+  cell.key.days          = pTarget->daysSince2000;
+  cell.key.angle         = pTarget->twilightAngle;
+  cell.key.latitudeCell  = (int) floor (pTarget->latitude  / cache->cellDegrees);
+  cell.key.longitudeCell = (int) floor (pTarget->longitude / cache->cellDegrees);
+  cell.key.engine        = pTarget->engine;
+  cell.key.refine        = pTarget->refine;
+
+  /* A shared ephemeris is only usable for its own day */
+  if (pEphemeris && pEphemeris->days != pTarget->daysSince2000) pEphemeris = NULL;
+
+  cellShardStruct *shard = &cache->shards[cellKeyHash () (cell.key) & (CELLCACHE_SHARDS - 1)];
+  boolean found = false;
+  { std::lock_guard<std::mutex> lock (shard->mutex);
+    auto entry = shard->index.find (cell.key);
+    if (entry != shard->index.end ())
+    { shard->cells.splice (shard->cells.begin (), shard->cells, entry->second);
+      cell  = *entry->second;
+      found = true;
+    }
+  }
+
+  if (found) cache->hits++;
+  else
+  { cache->misses++;
+    buildCell (cache, pTarget, pEphemeris, &cell);
+    std::lock_guard<std::mutex> lock (shard->mutex);
+    if (shard->index.find (cell.key) == shard->index.end ())
+    { shard->cells.push_front (cell);
+      shard->index[cell.key] = shard->cells.begin ();
+      if (shard->cells.size () > cache->shardCapacity)
+      { shard->index.erase (shard->cells.back ().key);
+        shard->cells.pop_back ();
+      }
+    }
+  }
+
+  if (cell.exact)
+  { cache->exact++;
+    targetStruct result;
+    exactSunriset (pTarget, pEphemeris, pTarget->latitude, pTarget->longitude, &result);
+    pTarget->dayType  = result.dayType;
+    pTarget->riseTime = result.riseTime;
+    pTarget->noonTime = result.noonTime;
+    pTarget->setTime  = result.setTime;
+    return;
+  }
+
+  double u = pTarget->latitude  / cache->cellDegrees - cell.key.latitudeCell;
+  double v = pTarget->longitude / cache->cellDegrees - cell.key.longitudeCell;
+  pTarget->dayType  = cell.dayType;
+  pTarget->noonTime = interpolate (cell.noon, u, v);
+  if (cell.dayType == DAYTYPE_NORMAL)
+  { pTarget->riseTime = interpolate (cell.rise, u, v);
+    pTarget->setTime  = interpolate (cell.set,  u, v);
+  }
+  else
+  { pTarget->riseTime = NOT_SET;
+    pTarget->setTime  = NOT_SET;
+  }
+}
+
+void print_cellcache (const cellCacheStruct *pCache)
+{
+  unsigned long long hits = pCache->hits, misses = pCache->misses, exact = pCache->exact;
+  unsigned long long total = hits + misses;
+  printf ( "Debug: Cell cache - %llu hits, %llu misses (%.1f%% hit rate), %llu answered exactly.\n"
+         , hits, misses, total ? 100.0 * hits / total : 0.0, exact);
+}
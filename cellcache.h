@@ -0,0 +1,31 @@
+#include "sunwait.h"
+#include "sunriset.h"
+
+#ifndef CELLCACHE_H
+  #define CELLCACHE_H
+
+/*
+** Cache of rise/set results for nearby locations. The globe is cut into square cells of a
+** configurable size; a cell holds exact results at its four corners for one day and twilight
+** angle, and answers for any point inside by bilinear interpolation.
+**
+** Each cell's interpolation error is bounded when the cell is built. Cells without a bound
+** within the allowed error (near polar day/night, or across the day boundary) are cached as
+** such, and points inside them are always computed exactly, as is everything for the NOAA
+** engine and for refined events.
+*/
+typedef struct cellCacheStruct cellCacheStruct;
+
+cellCacheStruct *cellcache_create (double pCellDegrees, double pMaxErrorSeconds);
+void             cellcache_free   (cellCacheStruct *pCache);
+
+/* As sunriset_ephemeris(), through pTarget->cache. pEphemeris may be NULL */
+void cellcache_sunriset (targetStruct *pTarget, const ephemerisStruct *pEphemeris);
+
+/* Cell size, degrees, and largest interpolation error, seconds, as created */
+void cellcache_settings (const cellCacheStruct *pCache, double *pCellDegrees, double *pMaxErrorSeconds);
+
+/* Debug line with the hit counters */
+void print_cellcache (const cellCacheStruct *pCache);
+
+#endif
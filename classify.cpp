@@ -0,0 +1,230 @@
+/*
+** classify.cpp - twilight phase of every row of a time-sorted log
+**
+** A log sorted by time and a day's changes of phase are both in time order, so the two are merged.
+** Each UT day's changes come from the unclamped rise and set, at each of the four twilight angles,
+** of the solar days overlapping it: the day before and after as well, so that at longitudes where
+** the sun rises or sets across midnight UT the change still falls where it happens. A solar day
+** runs from 12 hours before its transit to 12 hours before the next, so the solar days tile time
+** and polar day is never counted twice. Each solar day is evaluated once, with one ephemeris shared
+** by its four angles, and kept for the neighbouring UT days. A row then costs a compare or two.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "classify.h"
+
+static const double sAngles[CLASSIFY_ANGLES] =
+{ TWILIGHT_ANGLE_ASTRONOMICAL, TWILIGHT_ANGLE_NAUTICAL, TWILIGHT_ANGLE_CIVIL, TWILIGHT_ANGLE_DAYLIGHT };
+
+static const char *sPhaseNames[] = { "NIGHT", "ASTRO", "NAUTICAL", "CIVIL", "DAY" };
+
+void classify_init (classifyStruct *pClassify, const targetStruct *pTarget)
+{
+  memset (pClassify, 0, sizeof (*pClassify));
+  pClassify->target       = *pTarget;
+  pClassify->target.cache = NULL;   /* Built for one twilight angle only */
+}
+
+/*
+** One solar day's transit and, for each angle, when the sun is above it: unclamped, with the offset.
+** sunriset_ephemeris() hands the target's engine to noaa_sunriset() when it is set.
+*/
+static classifySunStruct solarDay (classifyStruct *pClassify, long long pDay)
+{
+  classifySunStruct *sun = &pClassify->sun[((pDay % CLASSIFY_CACHE) + CLASSIFY_CACHE) % CLASSIFY_CACHE];
+  if (sun->cached && sun->day == pDay) return *sun;
+
+  targetStruct *target = &pClassify->target;
+  target->daysSince2000 = pDay - DAYS_2000_JAN_0;
+  civilFromDaysSince2000 (target->daysSince2000, &target->year, &target->month, &target->dayOfMonth);
+
+  ephemerisStruct ephemeris;
+  sun_ephemeris (target->daysSince2000, &ephemeris);
+
+  double start = pDay * 86400.0;
+  for (int k=0; k < CLASSIFY_ANGLES; k++)
+  { target->twilightAngle = sAngles[k];
+    sunriset_ephemeris (target, &ephemeris);
+    if (k == 0) sun->transit = start + target->noonTime * 3600.0;
+
+    /* Polar day: above the whole solar day. Polar night: never */
+    if (target->dayType == DAYTYPE_POLAR_DAY)
+    { sun->from[k] = -HUGE_VAL;
+      sun->to[k]   =  HUGE_VAL;
+    }
+    else if (target->dayType == DAYTYPE_POLAR_NIGHT)
+      sun->from[k] = sun->to[k] = 0.0;
+    else
+    { sun->from[k] = start + (target->riseTime + target->hourOffset) * 3600.0;
+      sun->to[k]   = start + (target->setTime  - target->hourOffset) * 3600.0;
+      if (sun->to[k] < sun->from[k]) sun->to[k] = sun->from[k];
+    }
+  }
+
+  sun->cached = true;
+  sun->day    = pDay;
+  pClassify->days++;
+  return *sun;
+}
+
+/* A UT day's changes of phase, from the solar days before, of and after it */
+static void loadDay (classifyStruct *pClassify, long long pDay)
+{
+  double start = pDay * 86400.0, end = start + 86400.0;
+  double time[CLASSIFY_BOUNDS];
+  int    delta[CLASSIFY_BOUNDS];
+  int    count = 0, initial = 0;
+
+  classifySunStruct next = solarDay (pClassify, pDay - 1);
+  for (long long day = pDay - 1; day <= pDay + 1; day++)
+  { classifySunStruct sun = next;
+    next = solarDay (pClassify, day + 1);
+    double windowFrom = sun.transit  - 43200.0;
+    double windowTo   = next.transit - 43200.0;
+
+    for (int k=0; k < CLASSIFY_ANGLES; k++)
+    { double from = fmax (fmax (sun.from[k], windowFrom), start);
+      double to   = fmin (fmin (sun.to[k],   windowTo),   end);
+      if (from >= to) continue;
+      if (from <= start) initial++;
+      else { time[count] = from; delta[count++] = +1; }
+      if (to < end) { time[count] = to; delta[count++] = -1; }
+    }
+  }
+
+  /* In time order; changes at the same time are one bound */
+  for (int i=1; i < count; i++)
+    for (int j=i; j > 0 && time[j] < time[j - 1]; j--)
+    { double t = time[j]; time[j] = time[j - 1]; time[j - 1] = t;
+      int    d = delta[j]; delta[j] = delta[j - 1]; delta[j - 1] = d;
+    }
+
+  int level = initial > PHASE_DAY ? PHASE_DAY : initial;
+  pClassify->level[0] = (unsigned char) level;
+  pClassify->count    = 0;
+  for (int i=0; i < count; i++)
+  { level += delta[i];
+    level  = level < 0 ? 0 : (level > PHASE_DAY ? PHASE_DAY : level);
+    if (pClassify->count > 0 && pClassify->bound[pClassify->count - 1] == time[i])
+      pClassify->level[pClassify->count] = (unsigned char) level;
+    else
+    { pClassify->bound[pClassify->count] = time[i];
+      pClassify->level[++pClassify->count] = (unsigned char) level;
+    }
+  }
+
+  pClassify->loaded   = true;
+  pClassify->day      = pDay;
+  pClassify->start    = start;
+  pClassify->end      = end;
+  pClassify->position = 0;
+}
+
+void classify_times (classifyStruct *pClassify, const double *pTimes, size_t pCount, unsigned char *pPhases)
+{
+  for (size_t i=0; i < pCount; i++)
+  { double time = pTimes[i];
+    if (pClassify->loaded && time < pClassify->last)
+    { pClassify->reseeks++;
+      pClassify->position = 0;
+    }
+    if (!pClassify->loaded || time < pClassify->start || time >= pClassify->end)
+      loadDay (pClassify, (long long) floor (time / 86400.0));
+
+    /* The merge: past the day's bounds this row has reached, usually none or one */
+    while (pClassify->position < pClassify->count && time >= pClassify->bound[pClassify->position]) pClassify->position++;
+    pPhases[i]      = pClassify->level[pClassify->position];
+    pClassify->last = time;
+  }
+}
+
+/* Classify and print one batch of rows */
+static void flush
+( classifyStruct             *pClassify
+, std::string                *pText       // Each row as given, NUL separated
+, std::vector<double>        *pTimes
+, std::vector<unsigned char> *pPhases
+, std::string                *pOutput
+, double                     *pSeconds
+)
+{
+  size_t count = pTimes->size ();
+  pPhases->resize (count);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  classify_times (pClassify, pTimes->data (), count, pPhases->data ());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+  *pSeconds += elapsed.count ();
+
+  pOutput->clear ();
+  const char *text = pText->c_str ();
+  for (size_t i=0; i < count; i++)
+  { size_t length = strlen (text);
+    pOutput->append (text, length);
+    text += length + 1;
+    pOutput->push_back (',');
+    pOutput->append (sPhaseNames[(*pPhases)[i]]);
+    pOutput->push_back ('\n');
+  }
+  fwrite (pOutput->data (), 1, pOutput->size (), stdout);
+
+  pText->clear ();
+  pTimes->clear ();
+}
+
+void run_classify (targetStruct *pTarget)
+{
+  classifyStruct classify;
+  classify_init (&classify, pTarget);
+
+  char  *line = NULL;
+  size_t size = 0;
+  unsigned long lineNumber = 0, rows = 0;
+  double seconds = 0.0;
+  std::string text, output;
+  std::vector<double> times;
+  std::vector<unsigned char> phases;
+  ssize_t length;
+  while ((length = getline (&line, &size, stdin)) != -1)
+  {
+    lineNumber++;
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = '\0';
+    size_t skip = strspn (line, " \t");
+    if (line[skip] == '\0') continue;
+
+    /* The time is the first field, the rest of the line is passed through */
+    size_t timeLength = strcspn (line + skip, " \t,");
+    char   separator  = line[skip + timeLength];
+    line[skip + timeLength] = '\0';
+    long long days;
+    double    hours;
+    boolean   ok = parseIsoTime (line + skip, &days, &hours);
+    line[skip + timeLength] = separator;
+    if (!ok)
+    { flush (&classify, &text, &times, &phases, &output, &seconds);   /* Keep the output in input order */
+      printf ("ERROR Line %lu: expected \"YYYY-MM-DDTHH:MM[:SS] ...\"\n", lineNumber);
+      continue;
+    }
+
+    text.append (line, length + 1);
+    times.push_back (days * 86400.0 + hours * 3600.0);
+    rows++;
+    if (times.size () == CLASSIFY_BATCH) flush (&classify, &text, &times, &phases, &output, &seconds);
+  }
+  flush (&classify, &text, &times, &phases, &output, &seconds);
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Classify - %lu rows, %lu days evaluated, %lu out of order, %.3f seconds classifying, %.0f rows per second\n"
+           , rows, classify.days, classify.reseeks, seconds, rows / fmax (seconds, 1e-9));
+  fflush (stdout);
+  free (line);
+}
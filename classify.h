@@ -0,0 +1,73 @@
+#include <stddef.h>
+#include "sunwait.h"
+
+#ifndef CLASSIFY_H
+  #define CLASSIFY_H
+
+/* Rows classified at a time by 'classify' */
+#define CLASSIFY_BATCH  65536
+
+/* Twilight angles, from the widest: the phase of a time is how many of them the sun is above */
+#define CLASSIFY_ANGLES 4
+
+typedef enum
+{ PHASE_NIGHT        = 0
+, PHASE_ASTRONOMICAL = 1
+, PHASE_NAUTICAL     = 2
+, PHASE_CIVIL        = 3
+, PHASE_DAY          = 4
+} Phase;
+
+/* Solar days whose events are kept, for the UT days either side */
+#define CLASSIFY_CACHE  8
+
+/* Most changes of phase in one UT day: each angle's spans from three solar days, clipped to it */
+#define CLASSIFY_BOUNDS (6 * CLASSIFY_ANGLES)
+
+/*
+** One solar day's events, seconds since 1970: the sun is above angle k in [from[k], to[k]), within
+** the solar day, which runs from 12 hours before its transit to 12 hours before the next one.
+*/
+typedef struct
+{
+  boolean       cached;     // Slot holds the day below
+  long long     day;        // Days since 1970
+  double        transit;
+  double        from[CLASSIFY_ANGLES];
+  double        to[CLASSIFY_ANGLES];
+} classifySunStruct;
+
+/*
+** One UT day's phases: the phase is level[0] from the start of the day, and level[i+1] from
+** bound[i]. Built from the unclamped rise and set of the solar days overlapping the UT day, so
+** events either side of midnight UT fall where they happen, for any longitude.
+*/
+typedef struct
+{
+  targetStruct      target;     // Place, engine and offset. Twilight angle set per evaluation
+  classifySunStruct sun[CLASSIFY_CACHE];
+  boolean           loaded;     // The phases below are for 'day'
+  long long         day;        // Days since 1970 of the phases below
+  double            start;      // The day, [start, end)
+  double            end;
+  unsigned int      count;
+  double            bound[CLASSIFY_BOUNDS];
+  unsigned char     level[CLASSIFY_BOUNDS + 1];
+  unsigned int      position;   // Bounds passed by the last row
+  double            last;       // Time of the last row
+  unsigned long     days;       // Solar days evaluated
+  unsigned long     reseeks;    // Times earlier than the one before: input not in time order
+} classifyStruct;
+
+void classify_init (classifyStruct *pClassify, const targetStruct *pTarget);
+
+/*
+** Phase of each of pCount times (seconds since 1970 UTC). In time order, each day is evaluated once
+** and the rows are merged with its bounds; out of order still works, only more slowly.
+*/
+void classify_times (classifyStruct *pClassify, const double *pTimes, size_t pCount, unsigned char *pPhases);
+
+/* 'classify': each "YYYY-MM-DDTHH:MM[:SS] ..." line from standard input, followed by ",PHASE" */
+void run_classify (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+** clock.cpp - real and virtual clocks
+*/
+
+#include <stddef.h>
+#include <thread>
+#include <chrono>
+#include "clock.h"
+
+static double realNow (void *pContext)
+{
+  (void) pContext;
+  return std::chrono::duration<double> (std::chrono::system_clock::now ().time_since_epoch ()).count ();
+}
+
+static void realSleep (void *pContext, double pSeconds)
+{
+  (void) pContext;
+  if (pSeconds > 0) std::this_thread::sleep_for (std::chrono::duration<double> (pSeconds)); // this should work on all platforms
+}
+
+typedef struct
+{
+  double now;
+  double speed;
+} virtualClockStruct;
+
+static double virtualNow (void *pContext)
+{
+  return ((virtualClockStruct *) pContext)->now;
+}
+
+static void virtualSleep (void *pContext, double pSeconds)
+{
+  virtualClockStruct *clock = (virtualClockStruct *) pContext;
+  if (pSeconds <= 0) return;
+  if (clock->speed > 0) realSleep (NULL, pSeconds / clock->speed);
+  clock->now += pSeconds;
+}
+
+static const clockStruct realClock = { realNow, realSleep, NULL };
+static clockStruct        gClock   = realClock;
+static virtualClockStruct gVirtual;
+
+void clock_install (const clockStruct *pClock)
+{
+  gClock = pClock ? *pClock : realClock;
+}
+
+double clock_now (void)
+{
+  return gClock.now (gClock.context);
+}
+
+void clock_sleep (double pSeconds)
+{
+  gClock.sleep (gClock.context, pSeconds);
+}
+
+void clock_virtual (double pStart, double pSpeed)
+{
+  gVirtual.now   = pStart;
+  gVirtual.speed = pSpeed;
+  clockStruct clock = { virtualNow, virtualSleep, &gVirtual };
+  clock_install (&clock);
+}
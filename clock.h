@@ -0,0 +1,25 @@
+#ifndef CLOCK_H
+  #define CLOCK_H
+
+/*
+** Where "now" comes from, and how waiting is done. All times are seconds since 1970-01-01 UTC.
+** The real clock is used unless another one is installed, e.g. the virtual clock for simulations.
+*/
+typedef struct
+{
+  double (*now)   (void *pContext);
+  void   (*sleep) (void *pContext, double pSeconds);
+  void   *context;
+} clockStruct;
+
+void   clock_install (const clockStruct *pClock); // NULL: back to the real clock
+double clock_now     (void);
+void   clock_sleep   (double pSeconds);
+
+/*
+** Virtual clock starting at pStart. Sleeping moves it forward instantly when pSpeed is 0,
+** otherwise it really sleeps, pSpeed times faster than real time.
+*/
+void   clock_virtual (double pStart, double pSpeed);
+
+#endif
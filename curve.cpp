@@ -0,0 +1,215 @@
+/*
+** curve.cpp - piecewise-linear dimming schedules from the sun's altitude
+**
+** Each minute of the day the sun's altitude is mapped to a brightness through the transfer
+** function, and the day's 1441 samples (00:00 to 24:00) are reduced with the swinging door:
+** from the last point, every later sample allows a range of slopes, its value plus or minus the
+** error. While the ranges all overlap, one line from the last point passes within the error of
+** every sample so far; when they stop overlapping, that line ends at the previous minute, taking
+** the middle slope of the overlap, and the next begins there. The points are on the lines rather
+** than samples, which is what keeps every sample within the error.
+** Night and day are flat and cost nothing, so a day is typically a few dozen points.
+**
+** As in sunriset(), declination and hour angle are taken once per day, here at 12:00 UT, and
+** shared by all sites. The hour angle then advances a quarter degree a minute, by rotation.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+#include "table.h"
+#include "curve.h"
+
+typedef struct
+{
+  double sinDec;
+  double cosDec;
+  double hourAngle;   /* At 00:00 UT and longitude 0, degrees: gmst0 - sra */
+} curveDayStruct;
+
+static std::vector<curveDayStruct> sDays;
+static long long sFirstDay;
+static std::atomic<unsigned long> sPoints;
+
+boolean curve_parse_transfer (const char *pText, curveTransferStruct *pTransfer)
+{
+  memset (pTransfer, 0, sizeof (*pTransfer));
+  const char *text = pText;
+  while (*text)
+  { char *end;
+    double altitude = strtod (text, &end);
+    if (end == text || *end != ':') break;
+    text = end + 1;
+    double brightness = strtod (text, &end);
+    if (end == text || (*end && *end != ',')) break;
+    text = *end ? end + 1 : end;
+
+    if (pTransfer->count == CURVE_MAX_POINTS)
+    { printf ("Error: \"transfer\" has more than %d points.\n", CURVE_MAX_POINTS);
+      return false;
+    }
+    if (altitude < -90.0 || altitude > 90.0 || (pTransfer->count > 0 && altitude <= pTransfer->altitude[pTransfer->count - 1]))
+    { printf ("Error: \"transfer\" altitudes must increase, from -90 to 90 degrees: %s\n", pText);
+      return false;
+    }
+    pTransfer->altitude[pTransfer->count]   = altitude;
+    pTransfer->brightness[pTransfer->count] = brightness;
+    pTransfer->count++;
+  }
+
+  if (*text || pTransfer->count == 0)
+  { printf ("Error: Expected \"transfer altitude:brightness,...\": %s\n", pText);
+    return false;
+  }
+  return true;
+}
+
+typedef struct
+{
+  const curveTransferStruct *transfer;
+  double sinLowest;   /* Below this, the first brightness */
+  double sinHighest;  /* Above this, the last */
+} curveLookupStruct;
+
+static double brightness (const curveLookupStruct *pLookup, double pSinAltitude)
+{
+  const curveTransferStruct *transfer = pLookup->transfer;
+  if (pSinAltitude <= pLookup->sinLowest)  return transfer->brightness[0];
+  if (pSinAltitude >= pLookup->sinHighest) return transfer->brightness[transfer->count - 1];
+
+  double altitude = asind (pSinAltitude);
+  unsigned int k = 1;
+  while (k < transfer->count - 1 && altitude > transfer->altitude[k]) k++;
+  double fraction = (altitude - transfer->altitude[k - 1]) / (transfer->altitude[k] - transfer->altitude[k - 1]);
+  return transfer->brightness[k - 1] + (transfer->brightness[k] - transfer->brightness[k - 1]) * fraction;
+}
+
+/*
+** Slope for a line ending pSpan minutes after the last point: the middle of the door, but keeping the
+** end inside the transfer's range of brightness where the door allows
+*/
+static double doorSlope (double pLower, double pUpper, double pFrom, double pSpan, double pLowest, double pHighest)
+{
+  double slope = (pLower + pUpper) / 2.0;
+  slope = fmin (fmax (slope, (pLowest - pFrom) / pSpan), (pHighest - pFrom) / pSpan);
+  return fmin (fmax (slope, pLower), pUpper);
+}
+
+static void appendPoint (std::string *pOutput, const siteStruct *pSite, const targetStruct *pTarget, unsigned int pMinute, double pBrightness)
+{
+  char buffer[64];
+  append_site (pOutput, pSite);
+  pOutput->push_back (',');
+  append_date (pOutput, pTarget);
+  if (fabs (pBrightness) < 0.005) pBrightness = 0.0;   /* No "-0.00" */
+  snprintf (buffer, sizeof (buffer), ",%2.2u:%2.2u,%.2f\n", pMinute / 60, pMinute % 60, pBrightness);
+  pOutput->append (buffer);
+}
+
+static void curveChunk (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput)
+{
+  double sinLat = sind (pSite->latitude);
+  double cosLat = cosd (pSite->latitude);
+
+  curveLookupStruct lookup;
+  lookup.transfer   = pTarget->transfer;
+  lookup.sinLowest  = sind (lookup.transfer->altitude[0]);
+  lookup.sinHighest = sind (lookup.transfer->altitude[lookup.transfer->count - 1]);
+
+  /* Printing to 0.01 can add up to 0.005, so the door is that much narrower */
+  double lowest = HUGE_VAL, highest = -HUGE_VAL;
+  for (unsigned int k=0; k < lookup.transfer->count; k++)
+  { lowest  = fmin (lowest,  lookup.transfer->brightness[k]);
+    highest = fmax (highest, lookup.transfer->brightness[k]);
+  }
+
+  double error = fmax (pTarget->maxError - 0.005, 0.0);
+  double stepCos = cosd (15.0 / 60.0), stepSin = sind (15.0 / 60.0);
+  unsigned long points = 0;
+
+  for (unsigned int day=0; day < pDays; day++)
+  { const curveDayStruct *ephemeris = &sDays[pTarget->daysSince2000 - sFirstDay];
+    double a = sinLat * ephemeris->sinDec;
+    double b = cosLat * ephemeris->cosDec;
+    double hourAngle = ephemeris->hourAngle + pSite->longitude;
+    double cosH = cosd (hourAngle), sinH = sind (hourAngle);
+
+    /* The door: slopes, per minute, from the last point that pass within the error of every sample since */
+    unsigned int anchor = 0;
+    double anchorValue  = brightness (&lookup, a + b * cosH);
+    double upper = HUGE_VAL, lower = -HUGE_VAL;
+    appendPoint (pOutput, pSite, pTarget, 0, anchorValue);
+    points++;
+
+    for (unsigned int minute=1; minute <= CURVE_SAMPLES; minute++)
+    { double rotated = cosH * stepCos - sinH * stepSin;
+      sinH = sinH * stepCos + cosH * stepSin;
+      cosH = rotated;
+      double value = brightness (&lookup, a + b * cosH);
+
+      double span      = minute - anchor;
+      double nextUpper = fmin (upper, (value + error - anchorValue) / span);
+      double nextLower = fmax (lower, (value - error - anchorValue) / span);
+      if (nextLower > nextUpper)
+      { /*
+        ** The door has closed: end the line at the previous minute, on a slope that still fits every
+        ** sample up to it, and reopen the door from there
+        */
+        anchorValue += doorSlope (lower, upper, anchorValue, minute - 1 - anchor, lowest, highest) * (minute - 1 - anchor);
+        anchor       = minute - 1;
+        appendPoint (pOutput, pSite, pTarget, anchor, anchorValue);
+        points++;
+        nextUpper = value + error - anchorValue;
+        nextLower = value - error - anchorValue;
+      }
+      upper = nextUpper;
+      lower = nextLower;
+    }
+    appendPoint (pOutput, pSite, pTarget, CURVE_SAMPLES, anchorValue + doorSlope (lower, upper, anchorValue, CURVE_SAMPLES - anchor, lowest, highest) * (CURVE_SAMPLES - anchor));
+    points++;
+
+    pTarget->daysSince2000++;
+    civilFromDaysSince2000 (pTarget->daysSince2000, &pTarget->year, &pTarget->month, &pTarget->dayOfMonth);
+  }
+  sPoints += points;
+}
+
+boolean print_curve (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return false;
+  unsigned int days = pTarget->list;
+
+  /* Per-day declination and hour angle, at 12:00 UT */
+  sFirstDay = pTarget->daysSince2000;
+  sDays.resize (days);
+  for (unsigned int day=0; day < days; day++)
+  { ephemerisStruct ephemeris;
+    sun_ephemeris (sFirstDay + day + 0.5, &ephemeris);
+    sDays[day].sinDec    = sind (ephemeris.sdec);
+    sDays[day].cosDec    = cosd (ephemeris.sdec);
+    sDays[day].hourAngle = ephemeris.gmst0 - ephemeris.sra;
+  }
+
+  sPoints = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  boolean ok = run_table_output (pTarget, &sites, days, 32, curveChunk);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Curve - %.0f site-days, %.1f points per day, %.3f seconds, %.0f site-days per second\n"
+           , (double) sites.count * days, sPoints / fmax ((double) sites.count * days, 1.0)
+           , elapsed.count (), sites.count * days / fmax (elapsed.count (), 1e-9));
+
+  sDays.clear ();
+  free_sites (&sites);
+  return ok;
+}
@@ -0,0 +1,42 @@
+#include "sunwait.h"
+
+#ifndef CURVE_H
+  #define CURVE_H
+
+/* Default transfer: full brightness from civil twilight down, off once the sun is up */
+#define CURVE_TRANSFER      "-6:100,0:0"
+
+/* Default largest brightness error of the fitted curve */
+#define CURVE_MAX_ERROR     1.0
+
+/* Most points in a transfer function */
+#define CURVE_MAX_POINTS    32
+
+/* Samples per day the curve is fitted to: one a minute */
+#define CURVE_SAMPLES       1440
+
+/*
+** Brightness as a function of the sun's altitude: straight lines between the points, in order of
+** altitude, and the end values beyond them.
+*/
+typedef struct curveTransferStruct
+{
+  unsigned int count;
+  double       altitude[CURVE_MAX_POINTS];    // Degrees, increasing
+  double       brightness[CURVE_MAX_POINTS];
+} curveTransferStruct;
+
+/* "altitude:brightness,..." into pTransfer. False, having printed why, if it is not valid */
+boolean curve_parse_transfer (const char *pText, curveTransferStruct *pTransfer);
+
+/*
+** Piecewise-linear brightness schedule for each site (or the target's own location) and the 'list'
+** days from the target date. Rows are "site,YYYY-MM-DD,HH:MM,brightness", from 00:00 to 24:00 of
+** each UT day. Interpolating between rows is never further than pTarget->maxError from the
+** transfer function at any minute of the day; so a point may also lie up to that far beyond the
+** transfer's range, where the curve bends at its ends.
+** False if the output could not be written.
+*/
+boolean print_curve (targetStruct *pTarget);
+
+#endif
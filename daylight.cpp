@@ -0,0 +1,190 @@
+/*
+** daylight.cpp - compressed day/night index for one site and year
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "daylight.h"
+
+/* Minutes in slots [pFrom, pTo): each day's last slot, slot k*slotsPerDay - 1, may be short */
+static double slotMinutes (const daylightIndexStruct *pIndex, unsigned int pFrom, unsigned int pTo)
+{
+  unsigned int dayEnds = pTo / pIndex->slotsPerDay - pFrom / pIndex->slotsPerDay;
+  return (pTo - pFrom) * pIndex->resolution - dayEnds * (pIndex->resolution - pIndex->lastSlot);
+}
+
+/* First slot starting at or after a time of day */
+static unsigned int slotAtOrAfter (double pHours, double pResolution)
+{
+  return (unsigned int) ceil (pHours * 60.0 / pResolution - 1e-9);
+}
+
+boolean daylight_build (daylightIndexStruct *pIndex, targetStruct *pTarget, unsigned int pYear, double pResolution)
+{
+  memset (pIndex, 0, sizeof (*pIndex));
+  if (pResolution <= 0 || pResolution > 1440) return false;
+
+  pIndex->firstDay    = daysSince2000 (pYear, 1, 1);
+  pIndex->days        = (unsigned int) (daysSince2000 (pYear + 1, 1, 1) - pIndex->firstDay);
+  pIndex->resolution  = pResolution;
+  pIndex->slotsPerDay = (unsigned int) ceil (1440.0 / pResolution);
+  pIndex->lastSlot    = 1440.0 - (pIndex->slotsPerDay - 1) * pResolution;
+
+  /* At most two runs start per day (before and after a clamped midnight) */
+  unsigned int maxRuns = 2 * pIndex->days + 1;
+  pIndex->runStart    = (unsigned int *) malloc (maxRuns * sizeof (unsigned int));
+  pIndex->runEnd      = (unsigned int *) malloc (maxRuns * sizeof (unsigned int));
+  pIndex->runBefore   = (double *) malloc (maxRuns * sizeof (double));
+  pIndex->dayFirstRun = (unsigned int *) malloc ((pIndex->days + 1) * sizeof (unsigned int));
+  if (!pIndex->runStart || !pIndex->runEnd || !pIndex->runBefore || !pIndex->dayFirstRun)
+  { daylight_free (pIndex);
+    return false;
+  }
+
+  targetStruct target  = *pTarget;
+  target.daysSince2000 = pIndex->firstDay;
+
+  double before = 0;
+  for (unsigned int day=0; day < pIndex->days; day++, target.daysSince2000++)
+  {
+    sunriset (&target);
+
+    unsigned int dayStart = day * pIndex->slotsPerDay;
+    unsigned int start, end;
+    if (target.dayType == DAYTYPE_POLAR_DAY)
+    { start = dayStart;
+      end   = dayStart + pIndex->slotsPerDay;
+    }
+    else if (target.dayType == DAYTYPE_POLAR_NIGHT) continue;
+    else
+    { /* As poll(): DAY from the offset rise time, up to but excluding the offset set time */
+      start = dayStart + slotAtOrAfter (getOffsetRiseTime (&target), pResolution);
+      end   = dayStart + slotAtOrAfter (getOffsetSetTime  (&target), pResolution);
+      if (end > dayStart + pIndex->slotsPerDay) end = dayStart + pIndex->slotsPerDay;
+      if (end <= start) continue;
+    }
+
+    /* Join runs that meet at midnight */
+    if (pIndex->runCount > 0 && pIndex->runEnd[pIndex->runCount-1] == start)
+      pIndex->runEnd[pIndex->runCount-1] = end;
+    else
+    { pIndex->runStart [pIndex->runCount] = start;
+      pIndex->runEnd   [pIndex->runCount] = end;
+      pIndex->runBefore[pIndex->runCount] = before;
+      pIndex->runCount++;
+    }
+    before += slotMinutes (pIndex, start, end);
+  }
+
+  /* Per-day entry points make "is it day" a lookup plus a scan of at most a couple of runs */
+  unsigned int run = 0;
+  for (unsigned int day=0; day <= pIndex->days; day++)
+  { while (run < pIndex->runCount && pIndex->runEnd[run] <= day * pIndex->slotsPerDay) run++;
+    pIndex->dayFirstRun[day] = run;
+  }
+
+  return true;
+}
+
+void daylight_free (daylightIndexStruct *pIndex)
+{
+  free (pIndex->runStart);
+  free (pIndex->runEnd);
+  free (pIndex->runBefore);
+  free (pIndex->dayFirstRun);
+  memset (pIndex, 0, sizeof (*pIndex));
+}
+
+boolean daylight_slot (const daylightIndexStruct *pIndex, long long pDaysSince2000, double pHours, unsigned int *pSlot)
+{
+  long long day = pDaysSince2000 - pIndex->firstDay;
+  if (day < 0 || day >= pIndex->days || pHours < 0 || pHours >= 24.0) return false;
+  unsigned int slot = (unsigned int) floor (pHours * 60.0 / pIndex->resolution);
+  if (slot >= pIndex->slotsPerDay) slot = pIndex->slotsPerDay - 1;
+  *pSlot = (unsigned int) day * pIndex->slotsPerDay + slot;
+  return true;
+}
+
+boolean daylight_is_day (const daylightIndexStruct *pIndex, unsigned int pSlot)
+{
+  unsigned int day = pSlot / pIndex->slotsPerDay;
+  if (day >= pIndex->days) return false;
+  for (unsigned int run = pIndex->dayFirstRun[day]; run < pIndex->runCount && pIndex->runStart[run] <= pSlot; run++)
+    if (pSlot < pIndex->runEnd[run]) return true;
+  return false;
+}
+
+/* DAY minutes before pSlot */
+static double minutesBefore (const daylightIndexStruct *pIndex, unsigned int pSlot)
+{
+  /* Binary search for the last run starting before pSlot */
+  unsigned int low = 0, high = pIndex->runCount;
+  while (low < high)
+  { unsigned int middle = (low + high) / 2;
+    if (pIndex->runStart[middle] < pSlot) low = middle + 1;
+    else                                  high = middle;
+  }
+  if (low == 0) return 0;
+  unsigned int run = low - 1;
+  unsigned int end = pSlot < pIndex->runEnd[run] ? pSlot : pIndex->runEnd[run];
+  return pIndex->runBefore[run] + slotMinutes (pIndex, pIndex->runStart[run], end);
+}
+
+double daylight_minutes (const daylightIndexStruct *pIndex, unsigned int pFrom, unsigned int pTo)
+{
+  if (pTo <= pFrom) return 0;
+  return minutesBefore (pIndex, pTo) - minutesBefore (pIndex, pFrom);
+}
+
+/*
+** Build the index for the target's year, then answer queries from stdin, one per line:
+**   YYYY-MM-DDTHH:MM[:SS]          -> DAY or NIGHT
+**   YYYY-MM-DDTHH:MM[:SS] <same>   -> daylight minutes between the two times
+*/
+void run_daylight_index (targetStruct *pTarget)
+{
+  daylightIndexStruct index;
+  if (!daylight_build (&index, pTarget, pTarget->year, pTarget->resolution))
+  { printf ("Error: Unable to build daylight index at resolution %f minutes.\n", pTarget->resolution);
+    return;
+  }
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Daylight index - %u days, %u slots, %u runs, %lu bytes, %.1f daylight hours.\n"
+           , index.days, index.days * index.slotsPerDay, index.runCount
+           , (unsigned long) ((2 * index.runCount + index.days + 1) * sizeof (unsigned int) + index.runCount * sizeof (double))
+           , daylight_minutes (&index, 0, index.days * index.slotsPerDay) / 60.0);
+
+  char  *line = NULL;
+  size_t size = 0;
+  while (getline (&line, &size, stdin) != -1)
+  {
+    char *save = NULL;
+    char *first  = strtok_r (line, " \t\r\n", &save);
+    char *second = strtok_r (NULL, " \t\r\n", &save);
+    if (!first) continue;
+
+    long long    days;
+    double       hours;
+    unsigned int from, to;
+    if (!parseIsoTime (first, &days, &hours) || !daylight_slot (&index, days - DAYS_2000_JAN_0, hours, &from))
+    { printf ("ERROR Time outside indexed year: %s\n", first);
+      continue;
+    }
+
+    if (!second)
+      printf ("%s\n", daylight_is_day (&index, from) ? "DAY" : "NIGHT");
+    else if (!parseIsoTime (second, &days, &hours) || !daylight_slot (&index, days - DAYS_2000_JAN_0, hours, &to))
+      printf ("ERROR Time outside indexed year: %s\n", second);
+    else
+      printf ("%.0f\n", daylight_minutes (&index, from, to));
+  }
+  free (line);
+
+  daylight_free (&index);
+}
@@ -0,0 +1,39 @@
+#include "sunwait.h"
+
+#ifndef DAYLIGHT_H
+  #define DAYLIGHT_H
+
+/*
+** Day/night for one site over one year, at a fixed resolution, for the target's twilight angle and
+** offset. Slot s is DAY exactly when "poll" would say DAY at the slot's start time. DAY slots are
+** held as runs, each with the number of DAY slots before it, rather than as a plain bitmap.
+*/
+typedef struct
+{
+  long long     firstDay;     // Days since 2000 of slot zero (1st January)
+  unsigned int  days;
+  unsigned int  slotsPerDay;
+  double        resolution;   // Minutes per slot
+  double        lastSlot;     // Minutes in each day's last slot, short if resolution does not divide 1440
+  unsigned int  runCount;
+  unsigned int *runStart;     // DAY runs are slots [runStart, runEnd), in order
+  unsigned int *runEnd;
+  double       *runBefore;    // DAY minutes before each run: a prefix sum over run lengths
+  unsigned int *dayFirstRun;  // First run ending after each day's first slot, days+1 entries
+} daylightIndexStruct;
+
+boolean daylight_build (daylightIndexStruct *pIndex, targetStruct *pTarget, unsigned int pYear, double pResolution);
+void    daylight_free  (daylightIndexStruct *pIndex);
+
+/* Slot holding a time, false if outside the index */
+boolean daylight_slot  (const daylightIndexStruct *pIndex, long long pDaysSince2000, double pHours, unsigned int *pSlot);
+
+/* O(1): Is the slot DAY? */
+boolean daylight_is_day (const daylightIndexStruct *pIndex, unsigned int pSlot);
+
+/* O(log runs): minutes of the DAY slots in [pFrom, pTo), each day's last slot at its own length */
+double daylight_minutes (const daylightIndexStruct *pIndex, unsigned int pFrom, unsigned int pTo);
+
+void run_daylight_index (targetStruct *pTarget);
+
+#endif
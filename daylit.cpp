@@ -0,0 +1,394 @@
+/*
+** daylit.cpp - which sites are in daylight, by latitude band and longitude
+**
+** The sun's altitude at a site is
+**
+**   sin(alt) = sin(lat)*sin(dec) + cos(lat)*cos(dec)*cos(H),   H = longitude - subsolar longitude
+**
+** so alt > h exactly when cos(H) > c(lat) = (sin(h) - sin(lat)*sin(dec)) / (cos(lat)*cos(dec)),
+** that is |H| < w(lat) = acos(c(lat)). Over a band, w lies between the smallest and largest of its
+** values at the band's edges and where dc/dlat = 0 (sin(lat) = sin(dec)/sin(h)). Sites with |H|
+** under the smallest are daylit, over the largest are not, and only those between are checked.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "clock.h"
+#include "sites.h"
+#include "table.h"
+#include "daylit.h"
+
+typedef struct
+{
+  double sinDec;
+  double cosDec;
+  double subsolar;   /* Longitude, degrees E, 0 to 360 */
+} daylitSunStruct;
+
+typedef struct
+{
+  unsigned int from;  /* Index range in the sorted sites */
+  unsigned int to;
+} daylitRangeStruct;
+
+static int bandOf (double pLatitude)
+{
+  int band = (int) floor ((pLatitude + 90.0) / DAYLIT_BAND_DEGREES);
+  return band < 0 ? 0 : (band >= DAYLIT_BANDS ? DAYLIT_BANDS - 1 : band);
+}
+
+void daylit_build (daylitIndexStruct *pIndex, const siteListStruct *pSites)
+{
+  pIndex->sites = pSites;
+
+  std::vector<unsigned int> order (pSites->count);
+  for (size_t i=0; i < pSites->count; i++) order[i] = i;
+  std::sort (order.begin (), order.end (), [pSites] (unsigned int a, unsigned int b)
+  { int bandA = bandOf (rev180 (pSites->sites[a].latitude)), bandB = bandOf (rev180 (pSites->sites[b].latitude));
+    return bandA != bandB ? bandA < bandB : pSites->sites[a].longitude < pSites->sites[b].longitude;
+  });
+
+  pIndex->site      = order;
+  pIndex->longitude.resize (order.size ());
+  pIndex->sinLat.resize    (order.size ());
+  pIndex->cosLat.resize    (order.size ());
+  memset (pIndex->bandStart, 0, sizeof (pIndex->bandStart));
+  for (size_t i=0; i < order.size (); i++)
+  { const siteStruct *site = &pSites->sites[order[i]];
+    pIndex->longitude[i] = site->longitude;
+    pIndex->sinLat[i]    = sind (site->latitude);
+    pIndex->cosLat[i]    = cosd (site->latitude);
+    pIndex->bandStart[bandOf (rev180 (site->latitude)) + 1]++;
+  }
+  for (int band=0; band < DAYLIT_BANDS; band++) pIndex->bandStart[band + 1] += pIndex->bandStart[band];
+}
+
+/* The sun at an instant, as sun_alt_az() sees it */
+static void sunAt (double pTime, daylitSunStruct *pSun)
+{
+  double days  = floor (pTime / 86400.0);
+  double hours = (pTime - days * 86400.0) / 3600.0;
+  ephemerisStruct ephemeris;
+  sun_ephemeris (days - DAYS_2000_JAN_0 + hours / 24.0, &ephemeris);
+  pSun->sinDec   = sind (ephemeris.sdec);
+  pSun->cosDec   = cosd (ephemeris.sdec);
+  pSun->subsolar = revolution (ephemeris.sra - ephemeris.gmst0 - 15.0 * hours);
+}
+
+/* Half-width, degrees of longitude, of the interval above the altitude at one latitude */
+static double halfWidth (const daylitSunStruct *pSun, double pSinAltitude, double pLatitude)
+{
+  double c = (pSinAltitude - sind (pLatitude) * pSun->sinDec) / (cosd (pLatitude) * pSun->cosDec);
+  return c >= 1.0 ? 0.0 : (c <= -1.0 ? 180.0 : acosd (c));
+}
+
+static void bandWidths (const daylitSunStruct *pSun, double pSinAltitude, int pBand, double *pMin, double *pMax)
+{
+  double south = pBand * DAYLIT_BAND_DEGREES - 90.0, north = south + DAYLIT_BAND_DEGREES;
+  double a = halfWidth (pSun, pSinAltitude, south), b = halfWidth (pSun, pSinAltitude, north);
+  *pMin = fmin (a, b);
+  *pMax = fmax (a, b);
+
+  if (pSinAltitude != 0.0 && fabs (pSun->sinDec / pSinAltitude) < 1.0)
+  { double turning = asind (pSun->sinDec / pSinAltitude);
+    if (turning > south && turning < north)
+    { double w = halfWidth (pSun, pSinAltitude, turning);
+      *pMin = fmin (*pMin, w);
+      *pMax = fmax (*pMax, w);
+    }
+  }
+}
+
+/* Index ranges of a band's sites with longitude in the arc [pFrom, pFrom + pLength) */
+static void arcRanges (const daylitIndexStruct *pIndex, int pBand, double pFrom, double pLength, std::vector<daylitRangeStruct> *pRanges)
+{
+  unsigned int first = pIndex->bandStart[pBand], last = pIndex->bandStart[pBand + 1];
+  if (first == last || pLength <= 0.0) return;
+  if (pLength >= 360.0) { pRanges->push_back ({first, last}); return; }
+
+  const double *longitude = pIndex->longitude.data ();
+  double from = revolution (pFrom), to = from + pLength;
+  unsigned int start = std::lower_bound (longitude + first, longitude + last, from) - longitude;
+  if (to <= 360.0)
+  { unsigned int end = std::lower_bound (longitude + first, longitude + last, to) - longitude;
+    pRanges->push_back ({start, end});
+  }
+  else
+  { unsigned int end = std::lower_bound (longitude + first, longitude + last, to - 360.0) - longitude;
+    pRanges->push_back ({start, last});
+    pRanges->push_back ({first, end});
+  }
+}
+
+/* Sort and merge overlapping ranges, so each site is visited once */
+static void mergeRanges (std::vector<daylitRangeStruct> *pRanges)
+{
+  std::sort (pRanges->begin (), pRanges->end (), [] (const daylitRangeStruct &a, const daylitRangeStruct &b) { return a.from < b.from; });
+  size_t out = 0;
+  for (size_t i=0; i < pRanges->size (); i++)
+  { if ((*pRanges)[i].from >= (*pRanges)[i].to) continue;
+    if (out > 0 && (*pRanges)[i].from <= (*pRanges)[out - 1].to)
+      (*pRanges)[out - 1].to = std::max ((*pRanges)[out - 1].to, (*pRanges)[i].to);
+    else
+      (*pRanges)[out++] = (*pRanges)[i];
+  }
+  pRanges->resize (out);
+}
+
+static boolean isDaylit (const daylitIndexStruct *pIndex, const daylitSunStruct *pSun, double pSinAltitude, unsigned int pSorted)
+{
+  return pIndex->sinLat[pSorted] * pSun->sinDec
+       + pIndex->cosLat[pSorted] * pSun->cosDec * cosd (pIndex->longitude[pSorted] - pSun->subsolar) > pSinAltitude;
+}
+
+void daylit_query (const daylitIndexStruct *pIndex, double pTime, double pAltitude, std::vector<unsigned int> *pDaylit, size_t *pChecked)
+{
+  daylitSunStruct sun;
+  sunAt (pTime, &sun);
+  double sinAltitude = sind (pAltitude);
+
+  std::vector<daylitRangeStruct> inside, margin;
+  for (int band=0; band < DAYLIT_BANDS; band++)
+  { if (pIndex->bandStart[band] == pIndex->bandStart[band + 1]) continue;
+    double wMin, wMax;
+    bandWidths (&sun, sinAltitude, band, &wMin, &wMax);
+
+    inside.clear ();
+    margin.clear ();
+    arcRanges (pIndex, band, sun.subsolar - wMin, 2.0 * wMin, &inside);
+    arcRanges (pIndex, band, sun.subsolar + wMin, wMax - wMin, &margin);
+    arcRanges (pIndex, band, sun.subsolar - wMax, wMax - wMin, &margin);
+    mergeRanges (&margin);
+
+    for (const daylitRangeStruct &range : inside)
+      for (unsigned int i = range.from; i < range.to; i++) pDaylit->push_back (pIndex->site[i]);
+    for (const daylitRangeStruct &range : margin)
+    { if (pChecked) *pChecked += range.to - range.from;
+      for (unsigned int i = range.from; i < range.to; i++)
+        if (isDaylit (pIndex, &sun, sinAltitude, i)) pDaylit->push_back (pIndex->site[i]);
+    }
+  }
+}
+
+/* Sun samples across a transitions window, close enough together that linear interpolation holds */
+#define DAYLIT_KNOT_SECONDS 3600.0
+
+/* Crossing times are bisected to this */
+#define DAYLIT_CROSSING_SECONDS 0.5
+
+typedef struct
+{
+  double time;
+  double dec;
+  double sinDec;
+  double cosDec;
+  double subsolar;   /* Unwrapped, falling through the window */
+} daylitKnotStruct;
+
+/*
+** Bounds on w over a band and a declination range, by interval arithmetic on c. Looser than
+** bandWidths(), but it holds for every declination in the range, not just the ones sampled.
+*/
+static void bandWidthBounds (double pSinAltitude, int pBand, double pDecFrom, double pDecTo, double *pMin, double *pMax)
+{
+  double south = pBand * DAYLIT_BAND_DEGREES - 90.0, north = south + DAYLIT_BAND_DEGREES;
+  double sinLat[2] = { sind (south), sind (north) }, sinDec[2] = { sind (pDecFrom), sind (pDecTo) };
+  double numeratorMin = 1e9, numeratorMax = -1e9;
+  for (int i=0; i < 2; i++)
+    for (int j=0; j < 2; j++)
+    { double n = pSinAltitude - sinLat[i] * sinDec[j];
+      numeratorMin = fmin (numeratorMin, n);
+      numeratorMax = fmax (numeratorMax, n);
+    }
+
+  double cosLatMin = fmin (cosd (south), cosd (north)), cosLatMax = south < 0.0 && north > 0.0 ? 1.0 : fmax (cosd (south), cosd (north));
+  double cosDecMin = fmin (cosd (pDecFrom), cosd (pDecTo)), cosDecMax = pDecFrom < 0.0 && pDecTo > 0.0 ? 1.0 : fmax (cosd (pDecFrom), cosd (pDecTo));
+  double denominatorMin = cosLatMin * cosDecMin, denominatorMax = cosLatMax * cosDecMax;
+
+  double cMin = numeratorMin / (numeratorMin >= 0.0 ? denominatorMax : denominatorMin);
+  double cMax = numeratorMax / (numeratorMax >= 0.0 ? denominatorMin : denominatorMax);
+  *pMin = cMax >= 1.0 ? 0.0 : (cMax <= -1.0 ? 180.0 : acosd (cMax));
+  *pMax = cMin >= 1.0 ? 0.0 : (cMin <= -1.0 ? 180.0 : acosd (cMin));
+}
+
+/* How far the sun is above the altitude, in sine, at fraction pAt of the knot interval */
+static double excess (const daylitIndexStruct *pIndex, const daylitKnotStruct *pKnot, double pSinAltitude, unsigned int pSorted, double pAt)
+{
+  double sinDec   = pKnot[0].sinDec + pAt * (pKnot[1].sinDec - pKnot[0].sinDec);
+  double cosDec   = pKnot[0].cosDec + pAt * (pKnot[1].cosDec - pKnot[0].cosDec);
+  double subsolar = pKnot[0].subsolar + pAt * (pKnot[1].subsolar - pKnot[0].subsolar);
+  return pIndex->sinLat[pSorted] * sinDec + pIndex->cosLat[pSorted] * cosDec * cosd (pIndex->longitude[pSorted] - subsolar) - pSinAltitude;
+}
+
+/*
+** A site's crossings in one knot interval. Its H rises steadily, and only where H passes 0 or 180
+** can the altitude turn, so between those points there is at most one crossing to bisect for.
+*/
+static void siteCrossings (const daylitIndexStruct *pIndex, const daylitKnotStruct *pKnot, double pSinAltitude, unsigned int pSorted, std::vector<daylitEventStruct> *pEvents)
+{
+  double fromH = pIndex->longitude[pSorted] - pKnot[0].subsolar, toH = pIndex->longitude[pSorted] - pKnot[1].subsolar;
+  double span  = pKnot[1].time - pKnot[0].time;
+  double from  = 0.0, fromExcess = excess (pIndex, pKnot, pSinAltitude, pSorted, 0.0);
+  for (double turn = floor (fromH / 180.0) + 1.0; ; turn += 1.0)
+  { double to = turn * 180.0 < toH ? (turn * 180.0 - fromH) / (toH - fromH) : 1.0;
+    double toExcess = excess (pIndex, pKnot, pSinAltitude, pSorted, to);
+    if ((fromExcess > 0.0) != (toExcess > 0.0))
+    { double low = from, high = to;
+      while ((high - low) * span > DAYLIT_CROSSING_SECONDS)
+      { double middle = 0.5 * (low + high);
+        if ((excess (pIndex, pKnot, pSinAltitude, pSorted, middle) > 0.0) == (fromExcess > 0.0)) low = middle;
+        else high = middle;
+      }
+      pEvents->push_back ({pIndex->site[pSorted], pKnot[0].time + high * span, toExcess > 0.0});
+    }
+    if (to >= 1.0) break;
+    from       = to;
+    fromExcess = toExcess;
+  }
+}
+
+/*
+** The sun moves west, so each site's H grows by s = the subsolar point's travel. A site can only
+** change state if, during that travel, H passes the band's w: between the rising edges -w at the
+** two ends, or the setting edges +w, widened by how far w can range over the window. Each such
+** site's crossings are then found one by one, however many the window holds.
+*/
+void daylit_transitions (const daylitIndexStruct *pIndex, double pTime, double pSeconds, double pAltitude, std::vector<daylitEventStruct> *pEvents, size_t *pChecked)
+{
+  int intervals = pSeconds > DAYLIT_KNOT_SECONDS ? (int) ceil (pSeconds / DAYLIT_KNOT_SECONDS) : 1;
+  std::vector<daylitKnotStruct> knot (intervals + 1);
+  double decFrom = 90.0, decTo = -90.0, lastSubsolar = 0.0;
+  for (int i=0; i <= intervals; i++)
+  { daylitSunStruct sun;
+    knot[i].time = pTime + pSeconds * i / intervals;
+    sunAt (knot[i].time, &sun);
+    knot[i].dec    = atan2d (sun.sinDec, sun.cosDec);
+    knot[i].sinDec = sun.sinDec;
+    knot[i].cosDec = sun.cosDec;
+    if (i == 0) knot[i].subsolar = sun.subsolar;
+    else
+    { double seconds = knot[i].time - knot[i - 1].time;
+      knot[i].subsolar = knot[i - 1].subsolar - (seconds / 240.0 + rev180 (lastSubsolar - sun.subsolar - seconds / 240.0));
+    }
+    lastSubsolar = sun.subsolar;
+    decFrom = fmin (decFrom, knot[i].dec);
+    decTo   = fmax (decTo,   knot[i].dec);
+  }
+  double sinAltitude = sind (pAltitude);
+  double travel = knot[0].subsolar - knot[intervals].subsolar;
+  double end    = revolution (knot[intervals].subsolar);
+
+  std::vector<daylitRangeStruct> candidates;
+  for (int band=0; band < DAYLIT_BANDS; band++)
+  { if (pIndex->bandStart[band] == pIndex->bandStart[band + 1]) continue;
+    double wMin, wMax;
+    bandWidthBounds (sinAltitude, band, decFrom, decTo, &wMin, &wMax);
+
+    candidates.clear ();
+    arcRanges (pIndex, band, end + wMin, travel + wMax - wMin, &candidates);
+    arcRanges (pIndex, band, end - wMax, travel + wMax - wMin, &candidates);
+    mergeRanges (&candidates);
+
+    for (const daylitRangeStruct &range : candidates)
+    { if (pChecked) *pChecked += range.to - range.from;
+      for (unsigned int i = range.from; i < range.to; i++)
+        for (int k=0; k < intervals; k++) siteCrossings (pIndex, &knot[k], sinAltitude, i, pEvents);
+    }
+  }
+  std::sort (pEvents->begin (), pEvents->end (), [] (const daylitEventStruct &a, const daylitEventStruct &b) { return a.time < b.time; });
+}
+
+static void appendRows (std::string *pOutput, const char *pTime, const siteListStruct *pSites, const std::vector<unsigned int> *pList)
+{
+  for (unsigned int site : *pList)
+  { pOutput->append (pTime);
+    pOutput->push_back (',');
+    append_site (pOutput, &pSites->sites[site]);
+    pOutput->push_back ('\n');
+  }
+}
+
+static void appendEvents (std::string *pOutput, const char *pTime, const siteListStruct *pSites, const std::vector<daylitEventStruct> *pEvents)
+{
+  char iso[32];
+  for (const daylitEventStruct &event : *pEvents)
+  { long long days = (long long) floor (event.time / 86400.0);
+    formatIsoTime (iso, sizeof (iso), days, (event.time - days * 86400.0) / 3600.0);
+    pOutput->append (pTime);
+    pOutput->push_back (',');
+    append_site (pOutput, &pSites->sites[event.site]);
+    pOutput->append (event.rising ? ",rise," : ",set,");
+    pOutput->append (iso);
+    pOutput->push_back ('\n');
+  }
+}
+
+void run_daylit (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return;
+
+  daylitIndexStruct index;
+  daylit_build (&index, &sites);
+
+  /* Sunrise/set altitude, as sunriset() uses for the twilight angle */
+  double altitude = pTarget->twilightAngle;
+  if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altitude -= 0.2666;
+
+  char  *line = NULL;
+  size_t size = 0;
+  std::string output;
+  std::vector<unsigned int> daylit;
+  std::vector<daylitEventStruct> events;
+  while (getline (&line, &size, stdin) != -1)
+  {
+    char *save  = NULL;
+    char *token = strtok_r (line, " \t\r\n", &save);
+    if (!token) continue;
+
+    long long days;
+    double    hours, time;
+    if (!strcmp (token, "now")) time = clock_now ();
+    else if (parseIsoTime (token, &days, &hours)) time = days * 86400.0 + hours * 3600.0;
+    else
+    { printf ("ERROR Unknown time: %s\n", token);
+      continue;
+    }
+
+    char iso[32];
+    days = (long long) floor (time / 86400.0);
+    formatIsoTime (iso, sizeof (iso), days, (time - days * 86400.0) / 3600.0);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    size_t checked = 0;
+    output.clear ();
+    if (pTarget->within == 0)
+    { daylit.clear ();
+      daylit_query (&index, time, altitude, &daylit, &checked);
+      appendRows (&output, iso, &sites, &daylit);
+    }
+    else
+    { events.clear ();
+      daylit_transitions (&index, time, pTarget->within * 60.0, altitude, &events, &checked);
+      appendEvents (&output, iso, &sites, &events);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+    fwrite (output.data (), 1, output.size (), stdout);
+    if (pTarget->debug == ONOFF_ON)
+      printf ( "Debug: Daylit - %lu sites, %lu checked exactly, %.3f ms\n"
+             , (unsigned long) sites.count, (unsigned long) checked, elapsed.count () * 1000.0);
+  }
+  fflush (stdout);
+  free (line);
+  free_sites (&sites);
+}
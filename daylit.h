@@ -0,0 +1,57 @@
+#include <vector>
+#include "sunwait.h"
+#include "sites.h"
+
+#ifndef DAYLIT_H
+  #define DAYLIT_H
+
+/* Latitude bands of the site index */
+#define DAYLIT_BAND_DEGREES 0.5
+#define DAYLIT_BANDS        ((int) (180.0 / DAYLIT_BAND_DEGREES))
+
+/*
+** Sites grouped into latitude bands and sorted by longitude within each band. At any instant the
+** sites in a band where the sun is above an altitude lie in one longitude interval centred on the
+** subsolar longitude, so a query is a few binary searches per band. Only the sites in the
+** interval's margin, where the band's latitude range matters, are checked one by one.
+*/
+typedef struct
+{
+  const siteListStruct *sites;
+  std::vector<unsigned int> site;      // Site numbers, by band then longitude
+  std::vector<double>       longitude; // Degrees E, 0 to 360, parallel to 'site'
+  std::vector<double>       sinLat;
+  std::vector<double>       cosLat;
+  unsigned int bandStart[DAYLIT_BANDS + 1];
+} daylitIndexStruct;
+
+void daylit_build (daylitIndexStruct *pIndex, const siteListStruct *pSites);
+
+/*
+** Sites where the sun is above pAltitude at pTime (seconds since 1970 UTC), appended to pDaylit.
+** pChecked, if not NULL, counts the sites that needed an exact check.
+*/
+void daylit_query (const daylitIndexStruct *pIndex, double pTime, double pAltitude, std::vector<unsigned int> *pDaylit, size_t *pChecked);
+
+/* One site's crossing of the altitude */
+typedef struct
+{
+  unsigned int site;
+  double       time;      // Seconds since 1970 UTC
+  boolean      rising;
+} daylitEventStruct;
+
+/*
+** Every crossing of pAltitude between pTime and pTime + pSeconds, appended to pEvents in time
+** order. A site that rises and sets within the window gets both.
+*/
+void daylit_transitions (const daylitIndexStruct *pIndex, double pTime, double pSeconds, double pAltitude, std::vector<daylitEventStruct> *pEvents, size_t *pChecked);
+
+/*
+** For each "YYYY-MM-DDTHH:MM[:SS]" or "now" on standard input, print "time,site" for sites in
+** daylight or, with pTarget->within minutes, "time,site,rise|set,crossing time" for each
+** crossing in the next pTarget->within minutes.
+*/
+void run_daylit (targetStruct *pTarget);
+
+#endif
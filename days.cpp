@@ -0,0 +1,126 @@
+/*
+** days.cpp - calendar date <-> day number conversions
+**
+** See: Howard Hinnant, "chrono-Compatible Low-Level Date Algorithms".
+** Years are shifted to start in March, so the leap day is the last day of the (shifted) year and
+** month lengths follow the 153-day five month cycle. Eras are 400 years (146097 days) long.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include "days.h"
+
+long long daysFromCivil (long long pYear, unsigned int pMonth, unsigned int pDay)
+{
+  long long y   = pYear - (pMonth <= 2);
+  long long era = (y >= 0 ? y : y - 399) / 400;
+  unsigned int yoe = (unsigned int) (y - era * 400);                           /* [0, 399]    */
+  unsigned int doy = (153 * (pMonth + (pMonth > 2 ? -3 : 9)) + 2) / 5 + pDay - 1; /* [0, 365]    */
+  unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                    /* [0, 146096] */
+  return era * 146097 + (long long) doe - 719468;
+}
+
+void civilFromDays (long long pDays, long long *pYear, unsigned int *pMonth, unsigned int *pDay)
+{
+  long long z   = pDays + 719468;
+  long long era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned int doe = (unsigned int) (z - era * 146097);                        /* [0, 146096] */
+  unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;   /* [0, 399]    */
+  unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);                  /* [0, 365]    */
+  unsigned int mp  = (5 * doy + 2) / 153;                                      /* [0, 11]     */
+  *pDay   = doy - (153 * mp + 2) / 5 + 1;
+  *pMonth = mp < 10 ? mp + 3 : mp - 9;
+  *pYear  = (long long) yoe + era * 400 + (*pMonth <= 2);
+}
+
+/*
+** The bulk variants keep everything in 32-bit lanes and use selects rather than branches.
+** Floor division by 400 is done on a year offset that keeps values positive for years after -400000.
+*/
+void daysFromCivilBulk (const int *pYear, const unsigned int *pMonth, const unsigned int *pDay, long long *pDays, size_t pCount)
+{
+  for (size_t i=0; i < pCount; i++)
+  {
+    unsigned int m   = pMonth[i];
+    int          y   = pYear[i] - (m <= 2) + 400000;
+    int          era = y / 400;
+    unsigned int yoe = (unsigned int) (y - era * 400);
+    unsigned int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + pDay[i] - 1;
+    unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    pDays[i] = (long long) (era - 1000) * 146097 + (long long) doe - 719468;
+  }
+}
+
+void civilFromDaysBulk (const long long *pDays, int *pYear, unsigned int *pMonth, unsigned int *pDay, size_t pCount)
+{
+  for (size_t i=0; i < pCount; i++)
+  {
+    long long    z   = pDays[i] + 719468 + 1000LL * 146097;
+    int          era = (int) (z / 146097);
+    unsigned int doe = (unsigned int) (z - (long long) era * 146097);
+    unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned int mp  = (5 * doy + 2) / 153;
+    unsigned int m   = mp < 10 ? mp + 3 : mp - 9;
+    pDay[i]   = doy - (153 * mp + 2) / 5 + 1;
+    pMonth[i] = m;
+    pYear[i]  = (int) yoe + (era - 1000) * 400 + (m <= 2);
+  }
+}
+
+unsigned int daysInMonth (long long pYear, unsigned int pMonth)
+{
+  if (pMonth != 2) return 30 + ((pMonth + (pMonth > 7)) & 1);
+  return (pYear % 4 == 0 && (pYear % 100 != 0 || pYear % 400 == 0)) ? 29 : 28;
+}
+
+/* Parse exactly pDigits digits */
+static bool parseDigits (const char **pText, int pDigits, unsigned int *pNumber)
+{
+  unsigned int number = 0;
+  for (int i=0; i < pDigits; i++)
+  { char c = (*pText)[i];
+    if (c < '0' || c > '9') return false;
+    number = number * 10 + (c - '0');
+  }
+  *pText += pDigits;
+  *pNumber = number;
+  return true;
+}
+
+bool parseIsoTime (const char *pText, long long *pDays, double *pHours)
+{
+  unsigned int year, month, day, hour = 0, minute = 0, second = 0;
+
+  if (!parseDigits (&pText, 4, &year)  || *pText++ != '-') return false;
+  if (!parseDigits (&pText, 2, &month) || *pText++ != '-') return false;
+  if (!parseDigits (&pText, 2, &day)) return false;
+  if (month < 1 || month > 12 || day < 1 || day > daysInMonth (year, month)) return false;
+
+  if (*pText == 't' || *pText == 'T')
+  { pText++;
+    if (!parseDigits (&pText, 2, &hour) || *pText++ != ':') return false;
+    if (!parseDigits (&pText, 2, &minute)) return false;
+    if (*pText == ':' && !(pText++, parseDigits (&pText, 2, &second))) return false;
+    if (hour > 24 || minute > 59 || second > 60) return false;
+  }
+  if (*pText == 'z' || *pText == 'Z') pText++;
+  if (*pText != '\0') return false;
+
+  *pDays  = daysFromCivil (year, month, day);
+  *pHours = hour + minute / 60.0 + second / 3600.0;
+  return true;
+}
+
+void formatIsoTime (char *pBuffer, size_t pSize, long long pDays, double pHours)
+{
+  long long totalSeconds = (long long) floor (pHours * 3600.0 + 0.5);
+  long long days = pDays + (totalSeconds >= 0 ? totalSeconds / 86400 : -((86399 - totalSeconds) / 86400));
+  long long secondOfDay = totalSeconds - (days - pDays) * 86400;
+
+  long long year;
+  unsigned int month, day;
+  civilFromDays (days, &year, &month, &day);
+  snprintf ( pBuffer, pSize, "%04lld-%02u-%02uT%02lld:%02lld:%02lldZ"
+           , year, month, day, secondOfDay / 3600, (secondOfDay / 60) % 60, secondOfDay % 60);
+}
@@ -0,0 +1,30 @@
+#include <stddef.h>
+
+#ifndef DAYS_H
+  #define DAYS_H
+
+/*
+** Signed 64-bit day numbers, counting from 1970-01-01 (day 0), in the proleptic Gregorian calendar.
+** Conversions use H.Hinnant's era-based algorithms: no tables, no loops and no month switch.
+*/
+long long daysFromCivil (long long pYear, unsigned int pMonth, unsigned int pDay);
+void      civilFromDays (long long pDays, long long *pYear, unsigned int *pMonth, unsigned int *pDay);
+
+/* Days in a month, 1 to 12 */
+unsigned int daysInMonth (long long pYear, unsigned int pMonth);
+
+/* Bulk variants for whole columns of dates, written so the compiler can vectorize the loop bodies */
+void daysFromCivilBulk (const int *pYear, const unsigned int *pMonth, const unsigned int *pDay, long long *pDays, size_t pCount);
+void civilFromDaysBulk (const long long *pDays, int *pYear, unsigned int *pMonth, unsigned int *pDay, size_t pCount);
+
+/*
+** ISO 8601 UTC timestamps: "YYYY-MM-DD", "YYYY-MM-DDTHH:MM" or "YYYY-MM-DDTHH:MM:SS", optional "Z".
+** pHours is the time of day in hours. Formatting normalises hours outside 0 to 24 into the day.
+*/
+bool parseIsoTime  (const char *pText, long long *pDays, double *pHours);
+void formatIsoTime (char *pBuffer, size_t pSize, long long pDays, double pHours);
+
+/* Day number of 2000 Jan 0.0 (1999-12-31), the epoch used by sunriset.cpp */
+#define DAYS_2000_JAN_0 10956
+
+#endif
@@ -0,0 +1,90 @@
+/*
+** horizon.cpp - local horizon profiles
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "horizon.h"
+
+typedef struct
+{
+  double azimuth;
+  double elevation;
+} horizonPoint;
+
+boolean load_horizon (const char *pFileName, horizonStruct *pHorizon)
+{
+  FILE *file = fopen (pFileName, "r");
+  if (!file)
+  { printf ("Error: Unable to open horizon file: %s\n", pFileName);
+    return false;
+  }
+
+  std::vector<horizonPoint> points;
+  char line[256];
+  unsigned int lineNumber = 0;
+  while (fgets (line, sizeof (line), file))
+  { lineNumber++;
+    horizonPoint point;
+    char first[2];
+    if (sscanf (line, " %1s", first) != 1 || first[0] == '#') continue;
+    if (sscanf (line, " %lf%*[ ,\t]%lf", &point.azimuth, &point.elevation) != 2)
+    { printf ("Error: Expected \"azimuth elevation\" in horizon file %s, line %u.\n", pFileName, lineNumber);
+      continue;
+    }
+    point.azimuth = revolution (point.azimuth);
+    points.push_back (point);
+  }
+  fclose (file);
+
+  if (points.empty ())
+  { printf ("Error: No points in horizon file: %s\n", pFileName);
+    return false;
+  }
+
+  std::sort (points.begin (), points.end (), [](const horizonPoint &a, const horizonPoint &b) { return a.azimuth < b.azimuth; });
+
+  /* Interpolate every bin between its neighbouring points, wrapping around North */
+  size_t next = 0;
+  pHorizon->lowest  =  90.0;
+  pHorizon->highest = -90.0;
+  for (int bin=0; bin < HORIZON_BINS; bin++)
+  {
+    double azimuth = (double) bin / HORIZON_BINS_PER_DEGREE;
+    while (next < points.size () && points[next].azimuth < azimuth) next++;
+
+    const horizonPoint &after  = points[next % points.size ()];
+    const horizonPoint &before = points[(next + points.size () - 1) % points.size ()];
+    double span   = revolution (after.azimuth - before.azimuth);
+    double offset = revolution (azimuth - before.azimuth);
+    double elevation = (span > 0) ? before.elevation + (after.elevation - before.elevation) * offset / span
+                                  : before.elevation;
+
+    pHorizon->elevation[bin] = elevation;
+    if (elevation < pHorizon->lowest)  pHorizon->lowest  = elevation;
+    if (elevation > pHorizon->highest) pHorizon->highest = elevation;
+  }
+  pHorizon->elevation[HORIZON_BINS] = pHorizon->elevation[0];
+
+  pHorizon->steepest = 0;
+  for (int bin=0; bin < HORIZON_BINS; bin++)
+  { double slope = fabs (pHorizon->elevation[bin+1] - pHorizon->elevation[bin]) * HORIZON_BINS_PER_DEGREE;
+    if (slope > pHorizon->steepest) pHorizon->steepest = slope;
+  }
+
+  return true;
+}
+
+double horizon_elevation (const horizonStruct *pHorizon, double pAzimuth)
+{
+  double position = revolution (pAzimuth) * HORIZON_BINS_PER_DEGREE;
+  int    bin      = (int) position;
+  if (bin >= HORIZON_BINS) bin = HORIZON_BINS - 1;
+  double fraction = position - bin;
+  return pHorizon->elevation[bin] + (pHorizon->elevation[bin+1] - pHorizon->elevation[bin]) * fraction;
+}
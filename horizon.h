@@ -0,0 +1,28 @@
+#include "sunwait.h"
+
+#ifndef HORIZON_H
+  #define HORIZON_H
+
+/* Lookup table resolution: bins per degree of azimuth */
+#define HORIZON_BINS_PER_DEGREE 2
+#define HORIZON_BINS            (360 * HORIZON_BINS_PER_DEGREE)
+
+/*
+** Local horizon profile: elevation of the skyline (valley sides, buildings) by azimuth.
+** Read from a file of "azimuth elevation" lines, degrees, azimuth clockwise from North. Points
+** need not be evenly spaced; the table linearly interpolates between them, around the circle.
+*/
+typedef struct horizonStruct
+{
+  double elevation[HORIZON_BINS + 1]; // Last entry repeats the first, so lookups need no wrap
+  double lowest;
+  double highest;
+  double steepest;                    // Largest elevation change per degree of azimuth
+} horizonStruct;
+
+boolean load_horizon (const char *pFileName, horizonStruct *pHorizon);
+
+/* Skyline elevation at an azimuth, degrees */
+double horizon_elevation (const horizonStruct *pHorizon, double pAzimuth);
+
+#endif
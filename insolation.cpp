@@ -0,0 +1,173 @@
+/*
+** insolation.cpp - extraterrestrial and clear-sky irradiation over the day
+**
+** On a horizontal surface outside the atmosphere the irradiance at hour angle w is
+**
+**   G0 = Gsc/r^2 * (sin(lat)*sin(dec) + cos(lat)*cos(dec)*cos(w))
+**
+** which integrates in closed form: between hour angles w1 and w2 (degrees; 15 degrees an hour)
+**
+**   H0 = 12/pi * Gsc/r^2 * (cos(lat)*cos(dec)*(sin(w2) - sin(w1)) + pi/180*(w2 - w1)*sin(lat)*sin(dec))
+**
+** and for the whole day w runs over the diurnal arc to the geometric horizon, +-ws. Clear sky is
+** Meinel's direct normal 1353*0.7^(AM^0.678) W/m2 (Kasten-Young air mass), plus 10% diffuse,
+** times sin(alt): no closed form, so adaptive Simpson over the same limits.
+**
+** As in sunriset(), declination and distance are taken once per day, shared by all sites.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+#include "table.h"
+#include "insolation.h"
+
+typedef struct
+{
+  double sinDec;
+  double cosDec;
+  double distance;    /* 1/r^2 */
+  double hourAngle;   /* At 00:00 UT and longitude 0, degrees: gmst0 - sra */
+} insolationDayStruct;
+
+static std::vector<insolationDayStruct> sDays;
+static long long sFirstDay;
+
+typedef struct
+{
+  double a;           /* sin(lat)*sin(dec) */
+  double b;           /* cos(lat)*cos(dec) */
+} insolationSunStruct;
+
+/* Clear-sky global horizontal irradiance, W/m2, at hour angle pW */
+static double clearSky (const insolationSunStruct *pSun, double pW)
+{
+  double sinAltitude = pSun->a + pSun->b * cosd (pW);
+  if (sinAltitude <= 0.0) return 0.0;
+  double altitude = asind (sinAltitude);
+  double airMass  = 1.0 / (sinAltitude + 0.50572 * pow (altitude + 6.07995, -1.6364));
+  return 1.1 * 1353.0 * pow (0.7, pow (airMass, 0.678)) * sinAltitude;
+}
+
+static double simpson (const insolationSunStruct *pSun, double pA, double pB, double pFA, double pFM, double pFB, double pWhole, double pTolerance, int pDepth)
+{
+  double m = (pA + pB) / 2.0, lm = (pA + m) / 2.0, rm = (m + pB) / 2.0;
+  double flm = clearSky (pSun, lm), frm = clearSky (pSun, rm);
+  double left  = (m - pA) / 6.0 * (pFA + 4.0 * flm + pFM);
+  double right = (pB - m) / 6.0 * (pFM + 4.0 * frm + pFB);
+  if (pDepth <= 0 || fabs (left + right - pWhole) <= 15.0 * pTolerance)
+    return left + right + (left + right - pWhole) / 15.0;
+  return simpson (pSun, pA, m, pFA, flm, pFM, left,  pTolerance / 2.0, pDepth - 1)
+       + simpson (pSun, m, pB, pFM, frm, pFB, right, pTolerance / 2.0, pDepth - 1);
+}
+
+/* Clear-sky irradiation, Wh/m2, between hour angles pW1 and pW2 */
+static double clearSkyIrradiation (const insolationSunStruct *pSun, double pW1, double pW2)
+{
+  if (pW2 <= pW1) return 0.0;
+  double fa = clearSky (pSun, pW1), fm = clearSky (pSun, (pW1 + pW2) / 2.0), fb = clearSky (pSun, pW2);
+  double whole = (pW2 - pW1) / 6.0 * (fa + 4.0 * fm + fb);
+  /* Degrees of hour angle to hours: 1/15 */
+  return simpson (pSun, pW1, pW2, fa, fm, fb, whole, INSOLATION_TOLERANCE * 15.0, INSOLATION_DEPTH) / 15.0;
+}
+
+/* Extraterrestrial irradiation, Wh/m2, between hour angles pW1 and pW2, inside the day */
+static double extraterrestrial (const insolationSunStruct *pSun, double pDistance, double pW1, double pW2)
+{
+  if (pW2 <= pW1) return 0.0;
+  return 12.0 / PI * INSOLATION_SOLAR_CONSTANT * pDistance
+       * (pSun->b * (sind (pW2) - sind (pW1)) + DEGREE_TO_RADIAN * (pW2 - pW1) * pSun->a);
+}
+
+static void appendValues (std::string *pOutput, double pExtraterrestrial, double pClearSky)
+{
+  char buffer[64];
+  snprintf (buffer, sizeof (buffer), ",%.1f,%.1f\n", pExtraterrestrial, pClearSky);
+  pOutput->append (buffer);
+}
+
+static void insolationChunk (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput)
+{
+  double sinLat = sind (pSite->latitude);
+  double cosLat = cosd (pSite->latitude);
+
+  for (unsigned int day=0; day < pDays; day++)
+  { const insolationDayStruct *ephemeris = &sDays[pTarget->daysSince2000 - sFirstDay];
+    insolationSunStruct sun;
+    sun.a = sinLat * ephemeris->sinDec;
+    sun.b = cosLat * ephemeris->cosDec;
+
+    /* Half the diurnal arc to the geometric horizon: 0 in polar night, 180 in midnight sun */
+    double cost = sun.b > 0.0 ? -sun.a / sun.b : (sun.a > 0.0 ? -2.0 : 2.0);
+    double ws   = cost >= 1.0 ? 0.0 : (cost <= -1.0 ? 180.0 : acosd (cost));
+
+    if (pTarget->hourly == ONOFF_OFF)
+    { append_site (pOutput, pSite);
+      pOutput->push_back (',');
+      append_date (pOutput, pTarget);
+      appendValues (pOutput, extraterrestrial (&sun, ephemeris->distance, -ws, ws), clearSkyIrradiation (&sun, -ws, ws));
+    }
+    else
+    { /* Each UT hour spans 15 degrees of hour angle; the day is [-ws, ws] around it, or 360 on */
+      double w = rev180 (ephemeris->hourAngle + pSite->longitude);
+      for (int hour=0; hour < 24; hour++, w += 15.0)
+      { if (w >= 180.0) w -= 360.0;
+        double e = 0.0, c = 0.0;
+        for (double shift = 0.0; shift <= 360.0; shift += 360.0)
+        { double from = fmax (w - shift, -ws), to = fmin (w + 15.0 - shift, ws);
+          if (to <= from) continue;
+          e += extraterrestrial (&sun, ephemeris->distance, from, to);
+          c += clearSkyIrradiation (&sun, from, to);
+        }
+        if (e <= 0.0) continue;
+        append_site (pOutput, pSite);
+        pOutput->push_back (',');
+        append_date (pOutput, pTarget);
+        pOutput->push_back (',');
+        pOutput->push_back ('0' + hour / 10);
+        pOutput->push_back ('0' + hour % 10);
+        appendValues (pOutput, e, c);
+      }
+    }
+
+    pTarget->daysSince2000++;
+    civilFromDaysSince2000 (pTarget->daysSince2000, &pTarget->year, &pTarget->month, &pTarget->dayOfMonth);
+  }
+}
+
+boolean print_insolation (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return false;
+  unsigned int days = pTarget->list;
+
+  /* Per-day declination, distance and hour angle, at 12:00 UT */
+  sFirstDay = pTarget->daysSince2000;
+  sDays.resize (days);
+  for (unsigned int day=0; day < days; day++)
+  { ephemerisStruct ephemeris;
+    sun_ephemeris (sFirstDay + day + 0.5, &ephemeris);
+    sDays[day].sinDec    = sind (ephemeris.sdec);
+    sDays[day].cosDec    = cosd (ephemeris.sdec);
+    sDays[day].distance  = 1.0 / (ephemeris.sr * ephemeris.sr);
+    sDays[day].hourAngle = ephemeris.gmst0 - ephemeris.sra;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  boolean ok = run_table_output (pTarget, &sites, days, 32, insolationChunk);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Insolation - %.0f site-days, %.3f seconds, %.0f site-days per second\n"
+           , (double) sites.count * days, elapsed.count (), sites.count * days / fmax (elapsed.count (), 1e-9));
+
+  sDays.clear ();
+  free_sites (&sites);
+  return ok;
+}
@@ -0,0 +1,22 @@
+#include "sunwait.h"
+
+#ifndef INSOLATION_H
+  #define INSOLATION_H
+
+/* Solar constant, W/m2 */
+#define INSOLATION_SOLAR_CONSTANT 1361.0
+
+/* Adaptive Simpson tolerance, Wh/m2 per integral, and depth limit */
+#define INSOLATION_TOLERANCE      0.5
+#define INSOLATION_DEPTH          12
+
+/*
+** Extraterrestrial and clear-sky irradiation on a horizontal surface, Wh/m2, for each site (or the
+** target's own location) and the 'list' days from the target date. Daily rows are
+** "site,YYYY-MM-DD,extraterrestrial,clear-sky"; hourly rows, for the UT hours with the sun up,
+** "site,YYYY-MM-DD,HH,extraterrestrial,clear-sky".
+** False if the output could not be written.
+*/
+boolean print_insolation (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+** multiwait.cpp - wait for the first, or the last, of several events
+**
+** Each condition is a target of its own: same date, engine and options, its own place, twilight,
+** direction and offset. Their deadlines are computed once with sunriset() and wait_seconds(), and
+** the process sleeps to the nearest that is still pending, fires it, and goes on to the next until
+** the 'or' or 'and' is satisfied.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "clock.h"
+#include "print.h"
+#include "multiwait.h"
+
+void multiwait_add (waitConditionsStruct *pWait, const targetStruct *pTarget, const char *pSiteName)
+{
+  waitConditionStruct condition;
+  condition.latitude      = pTarget->latitude;
+  condition.longitude     = pTarget->longitude;
+  condition.siteName      = pSiteName;
+  condition.engine        = ENGINE_NOT_SET;
+  condition.twilightAngle = pTarget->twilightAngle;
+  condition.upDown        = pTarget->upDown;
+  condition.hourOffset    = pTarget->hourOffset;
+  pWait->conditions.push_back (condition);
+}
+
+static void printFired (size_t pCondition, double pTime, UpDown pUpDown)
+{
+  char iso[32];
+  long long days = (long long) floor (pTime / 86400.0);
+  formatIsoTime (iso, sizeof (iso), days, (pTime - days * 86400.0) / 3600.0);
+  printf ("%lu,%s,%s\n", (unsigned long) pCondition + 1, iso, pUpDown == UPDOWN_SUNRISE ? "rise" : "set");
+  fflush (stdout);
+}
+
+int multi_wait (targetStruct *pTarget, const waitConditionsStruct *pWait)
+{
+  /* A simulation runs this one wait from its start, on the virtual clock */
+  if (pTarget->simulate == ONOFF_ON)
+  { clock_virtual (pTarget->simulateFrom, pTarget->speed);
+    setNowTime (pTarget, clock_now ());
+    pTarget->year          = pTarget->nowYear;
+    pTarget->month         = pTarget->nowMonth;
+    pTarget->dayOfMonth    = pTarget->nowDayOfMonth;
+    pTarget->daysSince2000 = daysSince2000 (pTarget->year, pTarget->month, pTarget->dayOfMonth);
+  }
+
+  double now = clock_now ();
+  size_t count = pWait->conditions.size ();
+  std::vector<double> deadline (count);
+  std::vector<boolean> pending (count);
+  size_t waiting = 0;
+  for (size_t i=0; i < count; i++)
+  { const waitConditionStruct *condition = &pWait->conditions[i];
+    targetStruct target  = *pTarget;
+    target.latitude      = condition->latitude;
+    target.longitude     = condition->longitude;
+    target.twilightAngle = condition->twilightAngle;
+    target.upDown        = condition->upDown;
+    target.hourOffset    = condition->hourOffset;
+    if (condition->engine != ENGINE_NOT_SET) target.engine = condition->engine;
+    sunriset (&target);
+
+    double interval = wait_seconds (&target);
+    deadline[i] = now + interval;
+    pending[i]  = interval >= 0;
+    if (pending[i]) waiting++;
+    if (pTarget->debug == ONOFF_ON)
+      printf ( "Debug: Condition %lu - %f, %f, %s, wait (seconds): %.0f%s\n"
+             , (unsigned long) i + 1, target.latitude, target.longitude
+             , target.upDown == UPDOWN_SUNRISE ? "rise" : "set", interval, pending[i] ? "" : ", already passed");
+    print_refine (&target);
+  }
+
+  if (waiting == 0)
+  { if (pTarget->debug == ONOFF_ON) printf ("Debug: Every event already passed today.\n");
+    return EXIT_ERROR;
+  }
+
+  while (waiting > 0)
+  { size_t next = count;
+    for (size_t i=0; i < count; i++)
+      if (pending[i] && (next == count || deadline[i] < deadline[next])) next = i;
+
+    double interval = deadline[next] - clock_now ();
+    if (interval > 0)
+    { /* As "wait": in debug mode, a minute instead */
+      if (pTarget->debug == ONOFF_ON && pTarget->simulate == ONOFF_OFF)
+      { printf ("Debug: Debug mode, \"wait\" reduced from %.0f seconds to 1 minute.\n", interval);
+        interval = 60;
+      }
+      clock_sleep (interval);
+    }
+
+    pending[next] = false;
+    waiting--;
+    printFired (next, pTarget->simulate == ONOFF_ON ? deadline[next] : clock_now (), pWait->conditions[next].upDown);
+    if (pWait->all == ONOFF_OFF) break;
+  }
+
+  return EXIT_OK;
+}
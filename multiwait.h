@@ -0,0 +1,35 @@
+#include <vector>
+#include "sunwait.h"
+
+#ifndef MULTIWAIT_H
+  #define MULTIWAIT_H
+
+/* One 'wait' condition: where, which twilight, rise or set, and the offset */
+typedef struct
+{
+  double      latitude;
+  double      longitude;
+  const char *siteName;    // Looked up for latitude and longitude. NULL: as given
+  Engine      engine;      // From the site, else NOT_SET: the target's
+  double      twilightAngle;
+  UpDown      upDown;
+  double      hourOffset;
+} waitConditionStruct;
+
+typedef struct
+{
+  std::vector<waitConditionStruct> conditions;
+  OnOff all;               // 'and': wait for every condition. Else 'or': for the first
+} waitConditionsStruct;
+
+/* Copy of the target's condition fields, to start the next condition from */
+void multiwait_add (waitConditionsStruct *pWait, const targetStruct *pTarget, const char *pSiteName);
+
+/*
+** Wait for any or all of the conditions, for the target's date, holding one timer for the nearest
+** pending one. Conditions already passed are left out. Prints "N,time,rise|set" as condition N
+** (from 1, in command line order) fires. EXIT_ERROR if none is pending, as "wait".
+*/
+int multi_wait (targetStruct *pTarget, const waitConditionsStruct *pWait);
+
+#endif
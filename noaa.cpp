@@ -0,0 +1,188 @@
+/*
+** noaa.cpp - NOAA-style sunrise/sunset
+**
+** Based on the NOAA Global Monitoring Division solar calculator, which follows J. Meeus,
+** "Astronomical Algorithms". Unlike sunriset.cpp, which evaluates the sun's position once at
+** the start of the day, the position is evaluated at the time of each event, iterating
+** until successive estimates agree, giving timings good to well under a minute.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "horizon.h"
+#include "noaa.h"
+
+#define NOAA_ITERATIONS 4
+
+typedef struct
+{
+  double declination;     /* Degrees */
+  double equationOfTime;  /* Minutes */
+  double distance;        /* Astronomical units */
+} noaaSunStruct;
+
+/* Sun's position at pDays (days since 2000 Jan 0.0, including the fraction of the day, UT) */
+static void noaaSun (double pDays, noaaSunStruct *pSun)
+{
+  double T = (pDays - 1.5) / 36525.0;  /* Julian centuries since J2000.0 (2000 Jan 1.5) */
+
+  double L0 = revolution (280.46646 + T * (36000.76983 + T * 0.0003032)); /* Geometric mean longitude */
+  double M  = 357.52911 + T * (35999.05029 - T * 0.0001537);             /* Geometric mean anomaly */
+  double e  = 0.016708634 - T * (0.000042037 + T * 0.0000001267);        /* Orbit eccentricity */
+
+  double C = sind (M)       * (1.914602 - T * (0.004817 + T * 0.000014)) /* Equation of center */
+           + sind (2.0 * M) * (0.019993 - T * 0.000101)
+           + sind (3.0 * M) * 0.000289;
+
+  double trueLongitude = L0 + C;
+  double trueAnomaly   = M + C;
+  pSun->distance = 1.000001018 * (1.0 - e * e) / (1.0 + e * cosd (trueAnomaly));
+
+  double omega   = 125.04 - 1934.136 * T;
+  double lambda  = trueLongitude - 0.00569 - 0.00478 * sind (omega); /* Apparent longitude */
+  double epsilon = 23.0 + (26.0 + (21.448 - T * (46.815 + T * (0.00059 - T * 0.001813))) / 60.0) / 60.0
+                 + 0.00256 * cosd (omega);                           /* Corrected obliquity */
+
+  pSun->declination = asind (sind (epsilon) * sind (lambda));
+
+  double y = tand (epsilon / 2.0);
+  y *= y;
+  pSun->equationOfTime = 4.0 * RADIAN_TO_DEGREE *
+    ( y * sind (2.0 * L0)
+    - 2.0 * e * sind (M)
+    + 4.0 * e * y * sind (M) * cosd (2.0 * L0)
+    - 0.5 * y * y * sind (4.0 * L0)
+    - 1.25 * e * e * sind (2.0 * M)
+    );
+}
+
+/* Solar transit, hours GMT, on the day starting at pDays. Kept within the day, as sunriset() does */
+static double noaaTransit (double pDays, double pLongitude, noaaSunStruct *pSun)
+{
+  double transit = 12.0 - pLongitude / 15.0;
+  for (int i=0; i < NOAA_ITERATIONS; i++)
+  { noaaSun (pDays + transit / 24.0, pSun);
+    transit = 12.0 - pLongitude / 15.0 - pSun->equationOfTime / 60.0;
+    transit -= 24.0 * floor (transit / 24.0);
+  }
+  return transit;
+}
+
+/*
+** Rise (pDirection -1) or set (+1) time, hours GMT, starting from the transit estimate.
+** Returns false if the sun does not cross the altitude at the event's time of day.
+*/
+static boolean noaaEvent (targetStruct *pTarget, double pDays, double pLongitude, double pTransit, double pDirection, double *pTime)
+{
+  double time = pTransit;
+  for (int i=0; i < NOAA_ITERATIONS; i++)
+  { noaaSunStruct sun;
+    noaaSun (pDays + time / 24.0, &sun);
+
+    double altit = pTarget->twilightAngle;
+    if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altit -= 0.2666 / sun.distance;
+
+    double cost = (sind (altit) - sind (pTarget->latitude) * sind (sun.declination))
+                / (cosd (pTarget->latitude) * cosd (sun.declination));
+    if (fabs (cost) >= 1.0) return false;
+
+    double transit = 12.0 - pLongitude / 15.0 - sun.equationOfTime / 60.0;
+    transit += 24.0 * floor ((pTransit - transit) / 24.0 + 0.5);
+    double next    = transit + pDirection * acosd (cost) / 15.0;
+    boolean settled = fabs (next - time) < 0.1 / 3600.0;
+    time = next;
+    if (settled) break;
+  }
+  *pTime = time;
+  return true;
+}
+
+/*
+** The NOAA position at pHours on the day, as the fixed-position ephemeris the skyline solver
+** takes: sra and gmst0 chosen so the hour angle is NOAA's, 15*(time - transit) degrees. Fills
+** pAltit, and the transit on that ephemeris nearest pTransit.
+*/
+static void noaaEphemeris (const targetStruct *pTarget, double pDays, double pLongitude, double pTransit, double pHours, ephemerisStruct *pEphemeris, double *pAltit, double *pSouth)
+{
+  noaaSunStruct sun;
+  noaaSun (pDays + pHours / 24.0, &sun);
+  pEphemeris->days  = pDays;
+  pEphemeris->gmst0 = 180.0;
+  pEphemeris->sra   = -sun.equationOfTime / 4.0;
+  pEphemeris->sdec  = sun.declination;
+  pEphemeris->sr    = sun.distance;
+
+  *pAltit = pTarget->twilightAngle;
+  if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) *pAltit -= 0.2666 / sun.distance;
+  *pSouth = 12.0 - pLongitude / 15.0 - sun.equationOfTime / 60.0;
+  *pSouth += 24.0 * floor ((pTransit - *pSouth) / 24.0 + 0.5);
+}
+
+/*
+** Skyline rise or set (pRise true or false), hours GMT, re-solved with the sun's position at the
+** event's own time until the time settles, as noaaEvent() does for the flat horizon. If the sun
+** stops crossing on the way, the last time found stands.
+*/
+static double noaaHorizonEvent (const targetStruct *pTarget, double pDays, double pLongitude, double pTransit, boolean pRise, double pTime)
+{
+  double time = pTime;
+  for (int i=0; i < NOAA_ITERATIONS; i++)
+  { targetStruct    result = *pTarget;
+    ephemerisStruct ephemeris;
+    double altit, south;
+    noaaEphemeris (pTarget, pDays, pLongitude, pTransit, time, &ephemeris, &altit, &south);
+    horizon_sunriset (&result, &ephemeris, altit, south);
+    if (result.dayType != DAYTYPE_NORMAL) break;
+
+    double next = pRise ? result.riseTime : result.setTime;
+    boolean settled = fabs (next - time) < 0.1 / 3600.0;
+    time = next;
+    if (settled) break;
+  }
+  return time;
+}
+
+void noaa_sunriset (targetStruct *pTarget)
+{
+  double days      = pTarget->daysSince2000;
+  double longitude = rev180 (pTarget->longitude);
+
+  noaaSunStruct sun;
+  double transit = noaaTransit (days, longitude, &sun);
+
+  /* Day type at transit, as sunriset() */
+  double altit = pTarget->twilightAngle;
+  if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altit -= 0.2666 / sun.distance;
+  double cost = (sind (altit) - sind (pTarget->latitude) * sind (sun.declination))
+              / (cosd (pTarget->latitude) * cosd (sun.declination));
+
+  pTarget->noonTime = transit;
+  pTarget->riseTime = NOT_SET;
+  pTarget->setTime  = NOT_SET;
+
+  if (cost >= 1.0)       pTarget->dayType = DAYTYPE_POLAR_NIGHT;
+  else if (cost <= -1.0) pTarget->dayType = DAYTYPE_POLAR_DAY;
+  else
+  { double rise = transit, set = transit;
+    /* Near the polar transitions, the event's own declination may not give a crossing */
+    if (!noaaEvent (pTarget, days, longitude, transit, -1.0, &rise)) rise = transit - acosd (cost) / 15.0;
+    if (!noaaEvent (pTarget, days, longitude, transit, +1.0, &set))  set  = transit + acosd (cost) / 15.0;
+    pTarget->dayType  = DAYTYPE_NORMAL;
+    pTarget->riseTime = rise;
+    pTarget->setTime  = set;
+  }
+
+  /* The skyline: day type from the position at transit, then each event at its own time */
+  if (pTarget->horizon)
+  { ephemerisStruct ephemeris;
+    double horizonAltit, south;
+    noaaEphemeris (pTarget, days, longitude, transit, transit, &ephemeris, &horizonAltit, &south);
+    horizon_sunriset (pTarget, &ephemeris, horizonAltit, south);
+    if (pTarget->dayType == DAYTYPE_NORMAL)
+    { pTarget->riseTime = noaaHorizonEvent (pTarget, days, longitude, transit, true,  pTarget->riseTime);
+      pTarget->setTime  = noaaHorizonEvent (pTarget, days, longitude, transit, false, pTarget->setTime);
+    }
+  }
+}
@@ -0,0 +1,13 @@
+#include "sunwait.h"
+
+#ifndef NOAA_H
+  #define NOAA_H
+
+/*
+** High-precision alternative to sunriset(): the NOAA solar calculator's algorithm (after Meeus),
+** with the ephemeris re-evaluated at each event's own time until the time settles.
+** Fills the same targetStruct fields as sunriset().
+*/
+void noaa_sunriset (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+** pollcache.cpp - rise and set kept between invocations, for polls run from cron
+**
+** The file holds a few slots, each one day's result for one set of parameters, so several
+** differently configured polls can share it. A date or parameter change simply misses, and the
+** fresh result replaces the slot. The file is replaced whole by rename, so readers never see
+** a partial write.
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "horizon.h"
+#include "pollcache.h"
+
+static uint64_t hashBytes (const void *pData, size_t pLength, uint64_t pHash = 14695981039346656037ull)
+{
+  const unsigned char *data = (const unsigned char *) pData;
+  for (size_t i=0; i < pLength; i++) pHash = (pHash ^ data[i]) * 1099511628211ull;
+  return pHash;
+}
+
+static void makeKey (const targetStruct *pTarget, pollCacheKey *pKey)
+{
+  memset (pKey, 0, sizeof (*pKey));
+  pKey->latitude      = pTarget->latitude;
+  pKey->longitude     = pTarget->longitude;
+  pKey->twilightAngle = pTarget->twilightAngle;
+  pKey->daysSince2000 = pTarget->daysSince2000;
+  pKey->horizonHash   = pTarget->horizon ? hashBytes (pTarget->horizon->elevation, sizeof (pTarget->horizon->elevation)) : 0;
+  pKey->engine        = pTarget->engine;
+  pKey->refine        = pTarget->refine;
+}
+
+static uint32_t slotCheck (const pollCacheSlot *pSlot)
+{
+  return (uint32_t) hashBytes (pSlot, offsetof (pollCacheSlot, check));
+}
+
+/* Copy of the cache file into pFile, if it is one. Otherwise an empty cache */
+static boolean readCache (const char *pFileName, pollCacheFile *pFile)
+{
+  memset (pFile, 0, sizeof (*pFile));
+  memcpy (pFile->magic, POLLCACHE_MAGIC, 4);
+  pFile->slots = POLLCACHE_SLOTS;
+
+  int fd = open (pFileName, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat status;
+  void *data = MAP_FAILED;
+  if (fstat (fd, &status) == 0 && status.st_size == sizeof (pollCacheFile))
+    data = mmap (NULL, sizeof (pollCacheFile), PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) return false;
+
+  const pollCacheFile *file = (const pollCacheFile *) data;
+  boolean ok = !memcmp (file->magic, POLLCACHE_MAGIC, 4) && file->slots == POLLCACHE_SLOTS;
+  if (ok) memcpy (pFile, file, sizeof (*pFile));
+  munmap (data, sizeof (pollCacheFile));
+  return ok;
+}
+
+static boolean writeCache (const char *pFileName, const pollCacheFile *pFile)
+{
+  /* Per process, as cron may start several polls at once */
+  char temporary[4096];
+  snprintf (temporary, sizeof (temporary), "%s.%d.tmp", pFileName, (int) getpid ());
+  FILE *file = fopen (temporary, "wb");
+  if (!file) return false;
+
+  boolean ok = fwrite (pFile, sizeof (*pFile), 1, file) == 1;
+  if (fclose (file) != 0) ok = false;
+  if (ok && rename (temporary, pFileName) != 0) ok = false;
+  if (!ok) remove (temporary);
+  return ok;
+}
+
+void pollcache_sunriset (targetStruct *pTarget, const char *pFileName)
+{
+  pollCacheKey key;
+  makeKey (pTarget, &key);
+  uint64_t hash = hashBytes (&key, sizeof (key));
+  if (hash == 0) hash = 1;
+
+  pollCacheFile file;
+  boolean found = readCache (pFileName, &file);
+  pollCacheSlot *slot = &file.slot[hash % POLLCACHE_SLOTS];
+
+  if ( found && slot->hash == hash && !memcmp (&slot->key, &key, sizeof (key)) && slot->check == slotCheck (slot)
+    && (slot->dayType == DAYTYPE_NORMAL || slot->dayType == DAYTYPE_POLAR_DAY || slot->dayType == DAYTYPE_POLAR_NIGHT))
+  { pTarget->riseTime = slot->riseTime;
+    pTarget->noonTime = slot->noonTime;
+    pTarget->setTime  = slot->setTime;
+    pTarget->dayType  = (DayType) slot->dayType;
+    if (pTarget->debug == ONOFF_ON) printf ("Debug: Poll cache - hit in %s\n", pFileName);
+    return;
+  }
+
+  sunriset (pTarget);
+
+  memset (slot, 0, sizeof (*slot));
+  slot->key      = key;
+  slot->hash     = hash;
+  slot->riseTime = pTarget->riseTime;
+  slot->noonTime = pTarget->noonTime;
+  slot->setTime  = pTarget->setTime;
+  slot->dayType  = pTarget->dayType;
+  slot->check    = slotCheck (slot);
+
+  boolean written = writeCache (pFileName, &file);
+  if (pTarget->debug == ONOFF_ON)
+  { if (written) printf ("Debug: Poll cache - miss, stored in %s\n", pFileName);
+    else         printf ("Debug: Poll cache - miss, unable to write %s\n", pFileName);
+  }
+}
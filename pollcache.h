@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include "sunwait.h"
+
+#ifndef POLLCACHE_H
+  #define POLLCACHE_H
+
+#define POLLCACHE_MAGIC "SWP1"
+#define POLLCACHE_SLOTS 64
+#define POLLCACHE_FILE  "/run/sunwait.cache"
+
+/*
+** Everything sunriset() depends on for one day. Compared whole, so unused bytes must be zero.
+*/
+typedef struct
+{
+  double   latitude;
+  double   longitude;
+  double   twilightAngle;
+  int64_t  daysSince2000;  // The target's UTC date
+  uint64_t horizonHash;    // FNV-1a of the skyline table, 0 = no horizon
+  int32_t  engine;
+  int32_t  refine;
+} pollCacheKey;
+
+typedef struct
+{
+  pollCacheKey key;
+  uint64_t     hash;       // Of the key, which picks the slot. 0 = empty slot
+  double       riseTime;
+  double       noonTime;
+  double       setTime;
+  int32_t      dayType;
+  uint32_t     check;      // FNV-1a of the slot up to here
+} pollCacheSlot;
+
+typedef struct
+{
+  char          magic[4];
+  uint32_t      slots;
+  pollCacheSlot slot[POLLCACHE_SLOTS];
+} pollCacheFile;
+
+/*
+** sunriset() for the target, through the cache file: a valid entry for the same parameters and
+** date is used as is, otherwise the result is computed and stored. A cache that cannot be read or
+** written is only noted in debug, and the result is computed as usual.
+*/
+void pollcache_sunriset (targetStruct *pTarget, const char *pFileName);
+
+#endif
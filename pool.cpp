@@ -0,0 +1,130 @@
+/*
+** pool.cpp - work-stealing thread pool over a range of task numbers
+**
+** A worker's queue is a range [head, tail) of task numbers packed into one 64-bit atomic, so both
+** the owner (taking from head) and thieves (taking from tail) update it with a single CAS.
+*/
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "pool.h"
+
+struct alignas(64) poolQueue
+{
+  std::atomic<uint64_t> range; // head in the high 32 bits, tail in the low 32 bits
+};
+
+static inline uint64_t   packRange (uint32_t pHead, uint32_t pTail) { return ((uint64_t) pHead << 32) | pTail; }
+static inline uint32_t   rangeHead (uint64_t pRange) { return (uint32_t) (pRange >> 32); }
+static inline uint32_t   rangeTail (uint64_t pRange) { return (uint32_t) pRange; }
+
+typedef struct
+{
+  poolQueue          *queues;
+  unsigned int        threads;
+  size_t              base;      // Task number of range value zero, for pools over 2^32 tasks
+  poolTaskFunction    function;
+  void               *context;
+  std::atomic<size_t> remaining;
+} poolStruct;
+
+/* Take the next task from our own queue */
+static bool popTask (poolQueue *pQueue, uint32_t *pTask)
+{
+  uint64_t range = pQueue->range.load (std::memory_order_acquire);
+  while (rangeHead (range) < rangeTail (range))
+  { if (pQueue->range.compare_exchange_weak (range, packRange (rangeHead (range) + 1, rangeTail (range))))
+    { *pTask = rangeHead (range);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Move the back half of the fullest other queue into our own (empty) queue */
+static bool stealTasks (poolStruct *pPool, unsigned int pWorker)
+{
+  for (;;)
+  {
+    unsigned int victim = pWorker;
+    uint32_t     most   = 0;
+    for (unsigned int i=1; i < pPool->threads; i++)
+    { unsigned int candidate = (pWorker + i) % pPool->threads;
+      uint64_t range = pPool->queues[candidate].range.load (std::memory_order_relaxed);
+      uint32_t size  = rangeTail (range) - rangeHead (range);
+      if (rangeHead (range) < rangeTail (range) && size > most) { most = size; victim = candidate; }
+    }
+    if (victim == pWorker) return false;
+
+    poolQueue *queue = &pPool->queues[victim];
+    uint64_t range = queue->range.load (std::memory_order_acquire);
+    uint32_t head = rangeHead (range), tail = rangeTail (range);
+    if (head >= tail) continue;
+
+    uint32_t split = tail - (tail - head + 1) / 2;
+    if (queue->range.compare_exchange_strong (range, packRange (head, split)))
+    { pPool->queues[pWorker].range.store (packRange (split, tail), std::memory_order_release);
+      return true;
+    }
+  }
+}
+
+static void worker (poolStruct *pPool, unsigned int pWorker)
+{
+  poolQueue *own = &pPool->queues[pWorker];
+  uint32_t task;
+
+  while (pPool->remaining.load (std::memory_order_acquire) > 0)
+  {
+    if (popTask (own, &task))
+    { pPool->function (pPool->context, pPool->base + task);
+      pPool->remaining.fetch_sub (1, std::memory_order_acq_rel);
+    }
+    else if (!stealTasks (pPool, pWorker))
+      std::this_thread::yield ();
+  }
+}
+
+unsigned int pool_threads (unsigned int pThreads)
+{
+  if (pThreads > 0) return pThreads;
+  unsigned int cpus = std::thread::hardware_concurrency ();
+  return cpus > 0 ? cpus : 1;
+}
+
+void pool_run (unsigned int pThreads, size_t pTasks, poolTaskFunction pFunction, void *pContext)
+{
+  unsigned int threads = pool_threads (pThreads);
+  if (threads > pTasks) threads = pTasks > 0 ? (unsigned int) pTasks : 1;
+
+  /* Keep each pass within the 32-bit task numbers of a queue */
+  const size_t passLimit = 0x7fffffff;
+  for (size_t base = 0; base < pTasks; base += passLimit)
+  {
+    size_t tasks = (pTasks - base < passLimit) ? pTasks - base : passLimit;
+
+    if (threads == 1)
+    { for (size_t i=0; i < tasks; i++) pFunction (pContext, base + i);
+      continue;
+    }
+
+    std::vector<poolQueue> queues (threads);
+    poolStruct pool;
+    pool.queues   = queues.data ();
+    pool.threads  = threads;
+    pool.base     = base;
+    pool.function = pFunction;
+    pool.context  = pContext;
+    pool.remaining.store (tasks);
+
+    for (unsigned int w=0; w < threads; w++)
+      queues[w].range.store (packRange ((uint32_t) (tasks * w / threads), (uint32_t) (tasks * (w+1) / threads)));
+
+    std::vector<std::thread> workers;
+    for (unsigned int w=1; w < threads; w++) workers.push_back (std::thread (worker, &pool, w));
+    worker (&pool, 0);
+    for (size_t w=0; w < workers.size (); w++) workers[w].join ();
+  }
+}
@@ -0,0 +1,18 @@
+#include <stddef.h>
+
+#ifndef POOL_H
+  #define POOL_H
+
+/*
+** Run tasks 0 to pTasks-1 on a work-stealing pool of pThreads threads (0 = one per CPU).
+** Each worker starts with a contiguous share of the task range, takes tasks from the front of its
+** share and, once empty, steals the back half of the largest share it finds. Returns when all
+** tasks have completed. The calling thread is one of the workers.
+*/
+typedef void (*poolTaskFunction) (void *pContext, size_t pTask);
+
+void pool_run (unsigned int pThreads, size_t pTasks, poolTaskFunction pFunction, void *pContext);
+
+unsigned int pool_threads (unsigned int pThreads);
+
+#endif
@@ -129,6 +129,21 @@ void generate_report (targetStruct *pTarget)
   else if (pTarget->function == FUNCTION_LIST)    printf ("List\n");
   else if (pTarget->function == FUNCTION_USAGE)   printf ("Usage\n");
   else if (pTarget->function == FUNCTION_VERSION) printf ("Version\n");
+  else if (pTarget->function == FUNCTION_TERMINATOR) printf ("Terminator\n");
+  else if (pTarget->function == FUNCTION_TABLE)   printf ("Table\n");
+  else if (pTarget->function == FUNCTION_STREAM)  printf ("Stream\n");
+  else if (pTarget->function == FUNCTION_INDEX)   printf ("Index\n");
+  else if (pTarget->function == FUNCTION_AGGREGATE) printf ("Aggregate\n");
+  else if (pTarget->function == FUNCTION_BENCH)   printf ("Bench\n");
+  else if (pTarget->function == FUNCTION_DAYLIT)  printf ("Daylit\n");
+  else if (pTarget->function == FUNCTION_COMPILE) printf ("Compile\n");
+  else if (pTarget->function == FUNCTION_ARCHIVE) printf ("Archive\n");
+  else if (pTarget->function == FUNCTION_UNARCHIVE) printf ("Unarchive\n");
+  else if (pTarget->function == FUNCTION_TRACK)   printf ("Track\n");
+  else if (pTarget->function == FUNCTION_SOLARTIME) printf ("Solar time\n");
+  else if (pTarget->function == FUNCTION_INSOLATION) printf ("Insolation\n");
+  else if (pTarget->function == FUNCTION_CLASSIFY) printf ("Classify\n");
+  else if (pTarget->function == FUNCTION_CURVE)  printf ("Curve\n");
 
   printf ("\n\nTarget Information ...\n\n");
 
@@ -230,5 +245,16 @@ void print_list (targetStruct *pTarget)
       , getOffsetSetTime  (pTarget)
       );
     pTarget->daysSince2000++;
+    civilFromDaysSince2000 (pTarget->daysSince2000, &pTarget->year, &pTarget->month, &pTarget->dayOfMonth);
   }
+  print_refine (pTarget);
+}
+
+/* With refinement and debug, how many ephemeris evaluations each rise or set cost */
+void print_refine (const targetStruct *pTarget)
+{
+  if (pTarget->refine != ONOFF_ON || pTarget->debug != ONOFF_ON || pTarget->refineEvents == 0) return;
+  printf ( "Debug: Refine - %lu events, %lu iterations, %.2f per event.\n"
+         , pTarget->refineEvents, pTarget->refineIterations
+         , (double) pTarget->refineIterations / pTarget->refineEvents);
 }
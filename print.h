@@ -3,3 +3,5 @@
 void generate_report (targetStruct *pTarget);
 
 void print_list (targetStruct *pTarget);
+
+void print_refine (const targetStruct *pTarget);
@@ -0,0 +1,77 @@
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#ifndef RING_H
+  #define RING_H
+
+/*
+** Bounded lock-free ring for exactly one producer thread and one consumer thread.
+** Each side caches the other side's index, so the shared indices are only re-read
+** when the ring looks full (producer) or empty (consumer).
+*/
+template <typename T>
+class spscRing
+{
+public:
+  explicit spscRing (size_t pCapacity)
+  { size_t capacity = 2;
+    while (capacity < pCapacity) capacity *= 2;
+    mSlots.resize (capacity);
+    mMask = capacity - 1;
+  }
+
+  bool tryPush (T &pItem)
+  { size_t tail = mTail.load (std::memory_order_relaxed);
+    if (tail - mHeadCache > mMask)
+    { mHeadCache = mHead.load (std::memory_order_acquire);
+      if (tail - mHeadCache > mMask) return false;
+    }
+    mSlots[tail & mMask] = std::move (pItem);
+    mTail.store (tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop (T &pItem)
+  { size_t head = mHead.load (std::memory_order_relaxed);
+    if (head == mTailCache)
+    { mTailCache = mTail.load (std::memory_order_acquire);
+      if (head == mTailCache) return false;
+    }
+    pItem = std::move (mSlots[head & mMask]);
+    mHead.store (head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty () const
+  { return mHead.load (std::memory_order_acquire) == mTail.load (std::memory_order_acquire);
+  }
+
+  /* Blocking forms: spin briefly, then back off so an idle pipeline does not burn a CPU */
+  void push (T &pItem)
+  { for (unsigned int spin = 0; !tryPush (pItem); spin++) backoff (spin);
+  }
+
+  void pop (T &pItem)
+  { for (unsigned int spin = 0; !tryPop (pItem); spin++) backoff (spin);
+  }
+
+  static void backoff (unsigned int pSpin)
+  { if (pSpin < 64)        return;
+    else if (pSpin < 1024) std::this_thread::yield ();
+    else                   std::this_thread::sleep_for (std::chrono::microseconds (50));
+  }
+
+private:
+  std::vector<T> mSlots;
+  size_t         mMask;
+  alignas(64) std::atomic<size_t> mHead {0}; // Next slot to pop, written by the consumer
+  size_t         mTailCache = 0;             // Consumer's copy of mTail
+  alignas(64) std::atomic<size_t> mTail {0}; // Next slot to push, written by the producer
+  size_t         mHeadCache = 0;             // Producer's copy of mHead
+};
+
+#endif
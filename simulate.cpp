@@ -0,0 +1,100 @@
+/*
+** simulate.cpp - time-warp simulation of wait and poll
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "clock.h"
+#include "print.h"
+#include "simulate.h"
+
+/* Make the target's "now" and target date the virtual clock's time */
+static void setTarget (targetStruct *pTarget, double pNow)
+{
+  setNowTime (pTarget, pNow);
+  pTarget->year          = pTarget->nowYear;
+  pTarget->month         = pTarget->nowMonth;
+  pTarget->dayOfMonth    = pTarget->nowDayOfMonth;
+  pTarget->daysSince2000 = daysSince2000 (pTarget->year, pTarget->month, pTarget->dayOfMonth);
+}
+
+static void printEvent (double pTime, const char *pEvent)
+{
+  char iso[32];
+  long long days = (long long) floor (pTime / 86400.0);
+  formatIsoTime (iso, sizeof (iso), days, (pTime - days * 86400.0) / 3600.0);
+  printf ("%s %s\n", iso, pEvent);
+}
+
+/* As a "wait" run again straight after each time it returns. pTarget is the simulation's copy */
+static unsigned long long simulateWait (targetStruct *pTarget)
+{
+  unsigned long long decisions = 0;
+
+  for (double now = clock_now (); now < pTarget->simulateTo; now = clock_now ())
+  {
+    setTarget (pTarget, now);
+    sunriset (pTarget);
+    decisions++;
+
+    double interval = wait_seconds (pTarget);
+    if (interval < 0)
+    { /* Event passed: wait exits with an error, so try again tomorrow */
+      clock_sleep (86400.0 - fmod (now, 86400.0));
+      continue;
+    }
+    if (now + interval >= pTarget->simulateTo) break;
+
+    clock_sleep (interval);
+    printEvent (clock_now (), pTarget->upDown == UPDOWN_SUNSET ? "set" : "rise");
+    clock_sleep (1.0);
+  }
+  return decisions;
+}
+
+/* As a "poll" run every 'step' minutes. pTarget is the simulation's copy */
+static unsigned long long simulatePoll (targetStruct *pTarget)
+{
+  unsigned long long decisions = 0;
+  double step = pTarget->resolution * 60.0;
+  long long day = NOT_SET;
+  int previous = EXIT_OK;
+
+  for (double now = clock_now (); now < pTarget->simulateTo; clock_sleep (step), now = clock_now ())
+  {
+    setNowTime (pTarget, now);
+    /* Rise and set only change with the date */
+    if (day != (long long) floor (now / 86400.0))
+    { day = (long long) floor (now / 86400.0);
+      setTarget (pTarget, now);
+      sunriset (pTarget);
+    }
+
+    int decision = poll (pTarget);
+    decisions++;
+    if (decision != previous) printEvent (now, decision == EXIT_DAY ? "DAY" : "NIGHT");
+    previous = decision;
+  }
+  return decisions;
+}
+
+void run_simulation (targetStruct *pTarget)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  clock_virtual (pTarget->simulateFrom, pTarget->speed);
+
+  /* One copy throughout, so refinement can warm-start from the previous day */
+  targetStruct target = *pTarget;
+  unsigned long long decisions = (pTarget->function == FUNCTION_WAIT) ? simulateWait (&target) : simulatePoll (&target);
+
+  clock_install (NULL);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Simulated %llu decisions in %.3f seconds, %.0f per second.\n"
+           , decisions, elapsed.count (), decisions / fmax (elapsed.count (), 1e-9));
+  print_refine (&target);
+}
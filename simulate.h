@@ -0,0 +1,12 @@
+#include "sunwait.h"
+
+#ifndef SIMULATE_H
+  #define SIMULATE_H
+
+/*
+** Replay "wait" or "poll" decisions from pTarget->simulateFrom to simulateTo on a virtual clock,
+** printing a timeline: each time a wait fires, or each change in what poll returns.
+*/
+void run_simulation (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,422 @@
+/*
+** sites.cpp - loads a file of named sites for the multi-site modes, and finds sites by name
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+
+static boolean isSeparator (char c) { return c == ',' || c == ' ' || c == '\t' || c == ';'; }
+
+/*
+** Parse a coordinate starting at pText, ending before pEnd. Negative or S/W coordinates are
+** mirrored into 0 to 360, as main() does for command line bearings.
+*/
+static boolean parseCoordinate (const char *pText, const char *pEnd, char pPositive, char pNegative, double *pDegrees)
+{
+  char number[64];
+  size_t length = pEnd - pText;
+  if (length == 0 || length >= sizeof (number)) return false;
+  memcpy (number, pText, length);
+  number[length] = '\0';
+
+  char *rest;
+  double degrees = strtod (number, &rest);
+  if (rest == number) return false;
+
+       if (*rest == pPositive || *rest == pPositive - 'A' + 'a') rest++;
+  else if (*rest == pNegative || *rest == pNegative - 'A' + 'a') { degrees = -degrees; rest++; }
+  if (*rest != '\0') return false;
+
+  *pDegrees = revolution (degrees);
+  return true;
+}
+
+/* Engine name, "fast" or "noaa", in any case */
+static boolean parseEngine (const char *pText, const char *pEnd, Engine *pEngine)
+{
+  size_t length = pEnd - pText;
+       if (length == 4 && !strncasecmp (pText, "fast", 4)) *pEngine = ENGINE_FAST;
+  else if (length == 4 && !strncasecmp (pText, "noaa", 4)) *pEngine = ENGINE_NOAA;
+  else return false;
+  return true;
+}
+
+/* Whole file, mapped read-only. An empty file maps to NULL */
+static boolean mapFile (const char *pFileName, const char **pData, size_t *pSize)
+{
+  int fd = open (pFileName, O_RDONLY);
+  if (fd < 0)
+  { printf ("Error: Unable to open site file: %s\n", pFileName);
+    return false;
+  }
+
+  struct stat status;
+  if (fstat (fd, &status) != 0) { close (fd); return false; }
+  *pSize = status.st_size;
+  *pData = NULL;
+  if (*pSize > 0)
+  { void *data = mmap (NULL, *pSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    { printf ("Error: Unable to read site file: %s\n", pFileName);
+      close (fd);
+      return false;
+    }
+    *pData = (const char *) data;
+  }
+  close (fd);
+  return true;
+}
+
+static uint32_t hashName (const char *pName, size_t pLength)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i=0; i < pLength; i++) hash = (hash ^ (unsigned char) pName[i]) * 16777619u;
+  return hash;
+}
+
+/* Has the catalog's magic number, well-formed or not */
+static boolean isCatalog (const char *pData, size_t pSize)
+{
+  return pSize >= 4 && !memcmp (pData, SITE_CATALOG_MAGIC, 4);
+}
+
+/*
+** The catalog's header, if the mapped file is a well-formed catalog. Every record's name and every
+** index entry is checked against the file too, so a truncated or corrupt catalog is refused rather
+** than read out of bounds: one pass over the records and index, no parsing.
+*/
+static const siteCatalogHeader *catalogHeader (const char *pData, size_t pSize)
+{
+  if (pSize < sizeof (siteCatalogHeader) || memcmp (pData, SITE_CATALOG_MAGIC, 4)) return NULL;
+  const siteCatalogHeader *header = (const siteCatalogHeader *) pData;
+  if ( header->recordSize != sizeof (siteCatalogRecord)
+    || header->recordsOffset > pSize || header->recordsOffset % sizeof (double) != 0
+    || header->count > (pSize - header->recordsOffset) / sizeof (siteCatalogRecord)
+    || header->indexOffset > pSize || header->indexOffset % sizeof (uint32_t) != 0
+    || header->indexSize > (pSize - header->indexOffset) / sizeof (uint32_t)
+    || header->namesOffset > pSize
+    || header->indexSize == 0 || (header->indexSize & (header->indexSize - 1)) != 0 || header->indexSize <= header->count)
+    return NULL;
+
+  const siteCatalogRecord *record = (const siteCatalogRecord *) (pData + header->recordsOffset);
+  uint64_t namesSize = pSize - header->namesOffset;
+  for (uint64_t i=0; i < header->count; i++, record++)
+    if ( (uint64_t) record->nameOffset + record->nameLength > namesSize
+      || (record->engine != ENGINE_FAST && record->engine != ENGINE_NOAA && record->engine != ENGINE_NOT_SET)
+      || !isfinite (record->latitude) || !isfinite (record->longitude))
+      return NULL;
+
+  /* Entries name a record or are empty, and there is an empty one to end every probe */
+  const uint32_t *index = (const uint32_t *) (pData + header->indexOffset);
+  boolean empty = false;
+  for (uint64_t slot=0; slot < header->indexSize; slot++)
+  { if (index[slot] > header->count) return NULL;
+    if (index[slot] == 0) empty = true;
+  }
+  return empty ? header : NULL;
+}
+
+/* Record number + 1 of a name in a hash table, 0 if absent */
+static uint32_t probe
+( const uint32_t *pIndex, size_t pIndexSize, const char *pName, size_t pLength
+, const char *(*pNameOf) (const void *pContext, uint32_t pSite, size_t *pLength), const void *pContext
+)
+{
+  size_t slot = hashName (pName, pLength) & (pIndexSize - 1);
+  for (size_t step=0; step < pIndexSize && pIndex[slot]; step++, slot = (slot + 1) & (pIndexSize - 1))
+  { size_t length;
+    const char *name = pNameOf (pContext, pIndex[slot] - 1, &length);
+    if (length == pLength && !memcmp (name, pName, pLength)) return pIndex[slot];
+  }
+  return 0;
+}
+
+static const char *siteListName (const void *pContext, uint32_t pSite, size_t *pLength)
+{
+  const siteStruct *site = &((const siteListStruct *) pContext)->sites[pSite];
+  *pLength = site->nameLength;
+  return site->name;
+}
+
+static const char *catalogName (const void *pContext, uint32_t pSite, size_t *pLength)
+{
+  const siteCatalogHeader *header = (const siteCatalogHeader *) pContext;
+  const siteCatalogRecord *record = (const siteCatalogRecord *) ((const char *) header + header->recordsOffset) + pSite;
+  *pLength = record->nameLength;
+  return (const char *) header + header->namesOffset + record->nameOffset;
+}
+
+/* Split a line into name, latitude, longitude and engine fields. Returns the number of fields */
+static int splitFields (const char *pLine, const char *pEnd, const char *pField[4], const char *pFieldEnd[4])
+{
+  int fields = 0;
+  for (const char *p = pLine; p < pEnd && fields < 5; )
+  { while (p < pEnd && isSeparator (*p)) p++;
+    if (p >= pEnd) break;
+    if (fields == 0 && *p == '#') break;
+    const char *start = p;
+    while (p < pEnd && !isSeparator (*p)) p++;
+    if (fields < 4) { pField[fields] = start; pFieldEnd[fields] = p; }
+    fields++;
+  }
+  return fields;
+}
+
+/* Site from a line's fields, reporting errors against the file and line */
+static boolean siteFromFields (int pFields, const char *pField[4], const char *pFieldEnd[4], const char *pFileName, unsigned int pLineNumber, siteStruct *pSite)
+{
+  if (pFields != 3 && pFields != 4)
+  { printf ("Error: Expected \"name,latitude,longitude[,engine]\" in site file %s, line %u.\n", pFileName, pLineNumber);
+    return false;
+  }
+
+  pSite->name       = pField[0];
+  pSite->nameLength = pFieldEnd[0] - pField[0];
+  pSite->engine     = ENGINE_NOT_SET;
+  if (pFields == 4 && !parseEngine (pField[3], pFieldEnd[3], &pSite->engine))
+  { printf ("Error: Unknown engine in site file %s, line %u.\n", pFileName, pLineNumber);
+    return false;
+  }
+  if ( !parseCoordinate (pField[1], pFieldEnd[1], 'N', 'S', &pSite->latitude)
+    || !parseCoordinate (pField[2], pFieldEnd[2], 'E', 'W', &pSite->longitude))
+  { printf ("Error: Invalid coordinates in site file %s, line %u.\n", pFileName, pLineNumber);
+    return false;
+  }
+  return true;
+}
+
+static boolean loadText (const char *pFileName, siteListStruct *pSiteList)
+{
+  const char *buffer = pSiteList->buffer;
+  size_t      size   = pSiteList->bufferSize;
+
+  /* Upper bound on sites is the number of lines */
+  size_t lines = 1;
+  for (const char *p = buffer; p && (p = (const char *) memchr (p, '\n', buffer + size - p)) != NULL; p++) lines++;
+  pSiteList->sites = (siteStruct *) malloc (lines * sizeof (siteStruct));
+  if (!pSiteList->sites) return false;
+
+  unsigned int lineNumber = 0;
+  for (const char *line = buffer; line < buffer + size; )
+  {
+    const char *end = (const char *) memchr (line, '\n', buffer + size - line);
+    if (!end) end = buffer + size;
+    const char *next = end + 1;
+    if (end > line && end[-1] == '\r') end--;
+    lineNumber++;
+
+    const char *field[4], *fieldEnd[4];
+    int fields = splitFields (line, end, field, fieldEnd);
+    if (fields != 0 && siteFromFields (fields, field, fieldEnd, pFileName, lineNumber, &pSiteList->sites[pSiteList->count]))
+      pSiteList->count++;
+
+    line = next;
+  }
+  return true;
+}
+
+/*
+** Sites from the records, without parsing; the names and the index stay in the mapping. The records
+** are still copied, once, into siteStructs: every multi-site mode takes a siteStruct array, whose
+** names are pointers, and a record can only hold an offset. That copy is O(n), a few milliseconds
+** per million sites; lookup_site() is what answers a single site=NAME without it.
+*/
+static boolean loadCatalog (const siteCatalogHeader *pHeader, siteListStruct *pSiteList)
+{
+  const siteCatalogRecord *record = (const siteCatalogRecord *) ((const char *) pHeader + pHeader->recordsOffset);
+  const char *names = (const char *) pHeader + pHeader->namesOffset;
+
+  pSiteList->sites = (siteStruct *) malloc ((pHeader->count + 1) * sizeof (siteStruct));
+  if (!pSiteList->sites) return false;
+  for (size_t i=0; i < pHeader->count; i++, record++)
+  { siteStruct *site = &pSiteList->sites[i];
+    site->name       = names + record->nameOffset;
+    site->nameLength = record->nameLength;
+    site->latitude   = record->latitude;
+    site->longitude  = record->longitude;
+    site->engine     = (Engine) record->engine;
+  }
+  pSiteList->count     = pHeader->count;
+  pSiteList->index     = (const uint32_t *) ((const char *) pHeader + pHeader->indexOffset);
+  pSiteList->indexSize = pHeader->indexSize;
+  return true;
+}
+
+boolean load_sites (const char *pFileName, siteListStruct *pSiteList)
+{
+  memset (pSiteList, 0, sizeof (*pSiteList));
+  if (!mapFile (pFileName, &pSiteList->buffer, &pSiteList->bufferSize)) return false;
+
+  const siteCatalogHeader *header = catalogHeader (pSiteList->buffer, pSiteList->bufferSize);
+  if (!header && isCatalog (pSiteList->buffer, pSiteList->bufferSize))
+  { printf ("Error: Corrupt site catalog: %s\n", pFileName);
+    free_sites (pSiteList);
+    return false;
+  }
+  if (header ? !loadCatalog (header, pSiteList) : !loadText (pFileName, pSiteList))
+  { printf ("Error: Unable to read site file: %s\n", pFileName);
+    free_sites (pSiteList);
+    return false;
+  }
+  return true;
+}
+
+void free_sites (siteListStruct *pSiteList)
+{
+  if (pSiteList->buffer) munmap ((void *) pSiteList->buffer, pSiteList->bufferSize);
+  free (pSiteList->sites);
+  free (pSiteList->ownedIndex);
+  memset (pSiteList, 0, sizeof (*pSiteList));
+}
+
+/* Table at most half full. Where names repeat, the first site wins */
+static uint32_t *buildIndex (const siteListStruct *pSiteList, size_t *pIndexSize)
+{
+  size_t size = 16;
+  while (size < 2 * pSiteList->count) size *= 2;
+  uint32_t *index = (uint32_t *) calloc (size, sizeof (uint32_t));
+  if (!index) return NULL;
+
+  for (size_t i=0; i < pSiteList->count; i++)
+  { const siteStruct *site = &pSiteList->sites[i];
+    size_t slot = hashName (site->name, site->nameLength) & (size - 1);
+    boolean duplicate = false;
+    for (; index[slot]; slot = (slot + 1) & (size - 1))
+    { const siteStruct *other = &pSiteList->sites[index[slot] - 1];
+      if (other->nameLength == site->nameLength && !memcmp (other->name, site->name, site->nameLength)) { duplicate = true; break; }
+    }
+    if (!duplicate) index[slot] = i + 1;
+  }
+  *pIndexSize = size;
+  return index;
+}
+
+boolean index_sites (siteListStruct *pSiteList)
+{
+  if (pSiteList->index) return true;
+  pSiteList->ownedIndex = buildIndex (pSiteList, &pSiteList->indexSize);
+  pSiteList->index      = pSiteList->ownedIndex;
+  return pSiteList->index != NULL;
+}
+
+const siteStruct *find_site (const siteListStruct *pSiteList, const char *pName, size_t pLength)
+{
+  if (!pSiteList->index) return NULL;
+  uint32_t site = probe (pSiteList->index, pSiteList->indexSize, pName, pLength, siteListName, pSiteList);
+  return site ? &pSiteList->sites[site - 1] : NULL;
+}
+
+boolean lookup_site (const char *pFileName, const char *pName, siteStruct *pSite)
+{
+  const char *buffer;
+  size_t      size;
+  if (!mapFile (pFileName, &buffer, &size)) return false;
+
+  size_t  length = strlen (pName);
+  boolean found  = false;
+  const siteCatalogHeader *header = catalogHeader (buffer, size);
+  if (!header && isCatalog (buffer, size)) printf ("Error: Corrupt site catalog: %s\n", pFileName);
+  else if (header)
+  { const uint32_t *index = (const uint32_t *) (buffer + header->indexOffset);
+    uint32_t site = probe (index, header->indexSize, pName, length, catalogName, header);
+    if (site)
+    { const siteCatalogRecord *record = (const siteCatalogRecord *) (buffer + header->recordsOffset) + (site - 1);
+      pSite->latitude  = record->latitude;
+      pSite->longitude = record->longitude;
+      pSite->engine    = (Engine) record->engine;
+      found = true;
+    }
+  }
+  else
+  { /* Only the matching line is parsed */
+    unsigned int lineNumber = 0;
+    for (const char *line = buffer; !found && line < buffer + size; )
+    {
+      const char *end = (const char *) memchr (line, '\n', buffer + size - line);
+      if (!end) end = buffer + size;
+      const char *next = end + 1;
+      if (end > line && end[-1] == '\r') end--;
+      lineNumber++;
+
+      const char *name = line;
+      while (name < end && isSeparator (*name)) name++;
+      if ( (size_t) (end - name) > length && !memcmp (name, pName, length) && isSeparator (name[length]))
+      { const char *field[4], *fieldEnd[4];
+        int fields = splitFields (line, end, field, fieldEnd);
+        if (!siteFromFields (fields, field, fieldEnd, pFileName, lineNumber, pSite)) break;
+        found = true;
+      }
+      line = next;
+    }
+  }
+
+  pSite->name       = NULL;
+  pSite->nameLength = 0;
+  if (buffer) munmap ((void *) buffer, size);
+  return found;
+}
+
+boolean compile_sites (const siteListStruct *pSiteList, const char *pFileName)
+{
+  siteCatalogHeader header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, SITE_CATALOG_MAGIC, 4);
+  header.recordSize    = sizeof (siteCatalogRecord);
+  header.count         = pSiteList->count;
+  header.recordsOffset = sizeof (header);
+  header.indexOffset   = header.recordsOffset + header.count * sizeof (siteCatalogRecord);
+
+  size_t indexSize;
+  uint32_t *index = buildIndex (pSiteList, &indexSize);
+  if (!index) return false;
+  header.indexSize   = indexSize;
+  header.namesOffset = header.indexOffset + indexSize * sizeof (uint32_t);
+
+  /* Written beside the destination, then renamed over it */
+  char temporary[4096];
+  snprintf (temporary, sizeof (temporary), "%s.tmp", pFileName);
+  FILE *file = fopen (temporary, "wb");
+  if (!file)
+  { printf ("Error: Unable to create catalog: %s\n", temporary);
+    free (index);
+    return false;
+  }
+
+  boolean ok = fwrite (&header, sizeof (header), 1, file) == 1;
+  uint64_t nameOffset = 0;
+  for (size_t i=0; ok && i < pSiteList->count; i++)
+  { const siteStruct *site = &pSiteList->sites[i];
+    siteCatalogRecord record;
+    memset (&record, 0, sizeof (record));
+    record.latitude   = site->latitude;
+    record.longitude  = site->longitude;
+    record.nameOffset = (uint32_t) nameOffset;
+    record.nameLength = site->nameLength;
+    record.engine     = site->engine;
+    ok = fwrite (&record, sizeof (record), 1, file) == 1;
+    nameOffset += site->nameLength;
+    if (nameOffset > UINT32_MAX) ok = false;
+  }
+  ok = ok && fwrite (index, sizeof (uint32_t), indexSize, file) == indexSize;
+  for (size_t i=0; ok && i < pSiteList->count; i++)
+    ok = fwrite (pSiteList->sites[i].name, 1, pSiteList->sites[i].nameLength, file) == pSiteList->sites[i].nameLength;
+  free (index);
+
+  if (fclose (file) != 0) ok = false;
+  if (ok && rename (temporary, pFileName) != 0) ok = false;
+  if (!ok)
+  { printf ("Error: Unable to write catalog: %s\n", pFileName);
+    remove (temporary);
+  }
+  return ok;
+}
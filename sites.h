@@ -0,0 +1,80 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "sunwait.h"
+
+#ifndef SITES_H
+  #define SITES_H
+
+/*
+** A site file has one site per line: "name,latitude,longitude[,engine]".
+** Coordinates are signed floating-point degrees (+ve = N or E), or with [NESW] appended.
+** The optional engine, "fast" or "noaa", overrides the command line's for that site.
+** Fields may be separated by commas or whitespace. Blank lines and lines starting '#' are ignored.
+**
+** Or it is a compiled catalog (see compile_sites): records converted without parsing, names and
+** index used straight from the mapped file.
+*/
+typedef struct
+{
+  const char  *name;       // Points into the site list's mapped file, not NUL terminated
+  unsigned int nameLength;
+  double latitude;         // Degrees N, 0 to 360 like targetStruct
+  double longitude;        // Degrees E, 0 to 360 like targetStruct
+  Engine engine;           // ENGINE_NOT_SET: the target's engine
+} siteStruct;
+
+typedef struct
+{
+  const char *buffer;      // File contents, mapped read-only, owning the site names
+  size_t      bufferSize;
+  siteStruct *sites;
+  size_t      count;
+  const uint32_t *index;   // Name hash table: site number + 1, 0 = empty. NULL until index_sites()
+  size_t      indexSize;   // Power of two
+  uint32_t   *ownedIndex;  // The index, when built in memory rather than mapped from a catalog
+} siteListStruct;
+
+/*
+** Compiled catalog: header, then records, then the name hash table, then the names. Little-endian,
+** as written by this machine. Lookups hash the name with FNV-1a and probe linearly.
+*/
+#define SITE_CATALOG_MAGIC "SWC1"
+
+typedef struct
+{
+  char     magic[4];
+  uint32_t recordSize;
+  uint64_t count;
+  uint64_t indexSize;
+  uint64_t recordsOffset;
+  uint64_t indexOffset;
+  uint64_t namesOffset;
+} siteCatalogHeader;
+
+typedef struct
+{
+  double   latitude;
+  double   longitude;
+  uint32_t nameOffset;    // From the start of the names
+  uint32_t nameLength;
+  int32_t  engine;
+  uint32_t reserved;
+} siteCatalogRecord;
+
+boolean load_sites (const char *pFileName, siteListStruct *pSiteList);
+void    free_sites (siteListStruct *pSiteList);
+
+/* Name index for find_site(). A compiled catalog's is mapped with it, this builds one otherwise */
+boolean index_sites (siteListStruct *pSiteList);
+const siteStruct *find_site (const siteListStruct *pSiteList, const char *pName, size_t pLength);
+
+/*
+** One site's coordinates from a site file, without loading the rest: a hash lookup in a compiled
+** catalog, or a scan of the names in a text file. pSite's name is not set.
+*/
+boolean lookup_site (const char *pFileName, const char *pName, siteStruct *pSite);
+
+/* Write the sites as a compiled catalog */
+boolean compile_sites (const siteListStruct *pSiteList, const char *pFileName);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+** solartime.cpp - UTC to local apparent solar time, in bulk
+**
+** Apparent solar time is 12:00 at transit, so at longitude L (degrees E)
+**
+**   solar time = UT + L/15 + E(UT)
+**
+** where E, the equation of time, is 12 - transit at longitude 0. E changes by under 30 seconds a
+** day and smoothly, so it is taken from sunriset() once per day and interpolated linearly in
+** between: at local noon that reproduces sunriset()'s own transit for the longitude. The
+** per-row work is then branch-free arithmetic on columns.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "solartime.h"
+
+void solartime_init (solarTimeCacheStruct *pCache, const targetStruct *pTarget)
+{
+  pCache->target           = *pTarget;
+  pCache->target.latitude  = 0.0;
+  pCache->target.longitude = 0.0;
+  pCache->target.horizon   = NULL;
+  pCache->target.cache     = NULL;
+  pCache->firstDay         = 0;
+  pCache->equation.clear ();
+}
+
+static double equationOfTime (solarTimeCacheStruct *pCache, long long pDay)
+{
+  pCache->target.daysSince2000 = pDay - DAYS_2000_JAN_0;
+  sunriset (&pCache->target);
+  return 12.0 - pCache->target.noonTime;
+}
+
+/* Extend the cache to hold days pFirst to pLast */
+static boolean cover (solarTimeCacheStruct *pCache, long long pFirst, long long pLast)
+{
+  long long first = pCache->equation.empty () ? pFirst : (pFirst < pCache->firstDay ? pFirst : pCache->firstDay);
+  long long last  = pCache->equation.empty () ? pLast  : (pLast > pCache->firstDay + (long long) pCache->equation.size () - 1 ? pLast : pCache->firstDay + (long long) pCache->equation.size () - 1);
+  if (last - first + 1 > SOLARTIME_MAX_DAYS) return false;
+  if (!pCache->equation.empty () && first == pCache->firstDay && last - first + 1 == (long long) pCache->equation.size ()) return true;
+
+  std::vector<double> equation (last - first + 1);
+  for (long long day = first; day <= last; day++)
+  { long long old = day - pCache->firstDay;
+    equation[day - first] = (!pCache->equation.empty () && old >= 0 && old < (long long) pCache->equation.size ())
+                          ? pCache->equation[old] : equationOfTime (pCache, day);
+  }
+  pCache->equation.swap (equation);
+  pCache->firstDay = first;
+  return true;
+}
+
+boolean solartime_convert
+( solarTimeCacheStruct *pCache
+, const double         *pTimes
+, const double         *pLongitudes
+, double                pLongitude
+, size_t                pCount
+, double               *pSolarTime
+, double               *pHourAngle
+)
+{
+  if (pCount == 0) return true;
+
+  /* Sorted or not, one pass finds the days needed */
+  double lowest = pTimes[0], highest = pTimes[0];
+  for (size_t i=1; i < pCount; i++) { lowest = fmin (lowest, pTimes[i]); highest = fmax (highest, pTimes[i]); }
+  if (!isfinite (lowest) || !isfinite (highest)) return false;
+  if (!cover (pCache, (long long) floor (lowest / 86400.0), (long long) floor (highest / 86400.0) + 1)) return false;
+
+  const double *equation = pCache->equation.data ();
+  const double  firstDay = (double) pCache->firstDay;
+  for (size_t i=0; i < pCount; i++)
+  { double days      = pTimes[i] / 86400.0;
+    double day       = floor (days);
+    double fraction  = days - day;
+    size_t index     = (size_t) (day - firstDay);
+    double longitude = pLongitudes ? pLongitudes[i] : pLongitude;
+    double solar     = fraction * 24.0 + longitude / 15.0 + equation[index] + (equation[index + 1] - equation[index]) * fraction;
+    solar           -= 24.0 * floor (solar / 24.0);
+    pSolarTime[i]    = solar;
+    pHourAngle[i]    = 15.0 * (solar - 12.0);
+  }
+  return true;
+}
+
+static void appendDigits (std::string *pOutput, unsigned int pNumber, int pDigits)
+{
+  char digits[10];
+  for (int i = pDigits - 1; i >= 0; i--) { digits[i] = '0' + pNumber % 10; pNumber /= 10; }
+  pOutput->append (digits, pDigits);
+}
+
+/* Convert and print one batch of rows */
+static boolean flush
+( solarTimeCacheStruct *pCache
+, std::string          *pText       // Each row's time as given, NUL separated
+, std::vector<double>  *pTimes
+, std::vector<double>  *pLongitudes
+, std::vector<double>  *pSolarTime
+, std::vector<double>  *pHourAngle
+, std::string          *pOutput
+, double               *pSeconds
+)
+{
+  size_t count = pTimes->size ();
+  pSolarTime->resize (count);
+  pHourAngle->resize (count);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  boolean ok = solartime_convert (pCache, pTimes->data (), pLongitudes->data (), 0.0, count, pSolarTime->data (), pHourAngle->data ());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+  *pSeconds += elapsed.count ();
+  if (!ok) printf ("ERROR Times span more than %d days\n", SOLARTIME_MAX_DAYS);
+
+  pOutput->clear ();
+  const char *text = pText->c_str ();
+  for (size_t i=0; ok && i < count; i++)
+  { /* Solar time to the second, rounded, so 23:59:59.6 prints as 00:00:00 */
+    unsigned int second = (unsigned int) floor ((*pSolarTime)[i] * 3600.0 + 0.5) % 86400;
+    long long    angle  = llround ((*pHourAngle)[i] * 10000.0);
+    size_t       length = strlen (text);
+    pOutput->append (text, length);
+    text += length + 1;
+    pOutput->push_back (',');
+    appendDigits (pOutput, second / 3600, 2);
+    pOutput->push_back (':');
+    appendDigits (pOutput, second / 60 % 60, 2);
+    pOutput->push_back (':');
+    appendDigits (pOutput, second % 60, 2);
+    pOutput->append (angle < 0 ? ",-" : ",");
+    angle = llabs (angle);
+    appendDigits (pOutput, angle / 10000, angle >= 1000000 ? 3 : (angle >= 100000 ? 2 : 1));
+    pOutput->push_back ('.');
+    appendDigits (pOutput, angle % 10000, 4);
+    pOutput->push_back ('\n');
+  }
+  fwrite (pOutput->data (), 1, pOutput->size (), stdout);
+
+  pText->clear ();
+  pTimes->clear ();
+  pLongitudes->clear ();
+  return ok;
+}
+
+boolean run_solartime (targetStruct *pTarget)
+{
+  solarTimeCacheStruct cache;
+  solartime_init (&cache, pTarget);
+
+  double longitude = rev180 (pTarget->longitude);
+  char  *line = NULL;
+  size_t size = 0;
+  unsigned long lineNumber = 0, rows = 0;
+  double seconds = 0.0;
+  std::string text;
+  std::vector<double> times, longitudes, solarTime, hourAngle;
+  std::string output;
+  boolean ok = true;
+  while (getline (&line, &size, stdin) != -1)
+  {
+    lineNumber++;
+    char *save = NULL, *field[4];
+    int fields = 0;
+    for (char *token = strtok_r (line, " \t,\r\n", &save); token && fields < 4; token = strtok_r (NULL, " \t,\r\n", &save)) field[fields++] = token;
+    if (fields == 0) continue;
+
+    long long days;
+    double    hours, value = longitude;
+    char     *end = NULL;
+    if ( fields > 3 || !parseIsoTime (field[0], &days, &hours)
+      || (fields > 1 && (value = strtod (field[fields - 1], &end), *end)))
+    { printf ("ERROR Line %lu: expected \"YYYY-MM-DDTHH:MM[:SS] [[latitude] longitude]\"\n", lineNumber);
+      continue;
+    }
+
+    text.append (field[0], strlen (field[0]) + 1);
+    times.push_back (days * 86400.0 + hours * 3600.0);
+    longitudes.push_back (value);
+    rows++;
+    if (times.size () == SOLARTIME_BATCH && !flush (&cache, &text, &times, &longitudes, &solarTime, &hourAngle, &output, &seconds)) ok = false;
+  }
+  if (!flush (&cache, &text, &times, &longitudes, &solarTime, &hourAngle, &output, &seconds)) ok = false;
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Solar time - %lu rows, %lu days cached, %.3f seconds converting, %.0f rows per second\n"
+           , rows, (unsigned long) cache.equation.size (), seconds, rows / fmax (seconds, 1e-9));
+  if (fflush (stdout) != 0 || ferror (stdout)) ok = false;
+  free (line);
+  return ok;
+}
@@ -0,0 +1,48 @@
+#include <stddef.h>
+#include <vector>
+#include "sunwait.h"
+
+#ifndef SOLARTIME_H
+  #define SOLARTIME_H
+
+/* Rows converted at a time by 'solartime' */
+#define SOLARTIME_BATCH    65536
+
+/* Widest span of days the cache will hold, about a thousand years */
+#define SOLARTIME_MAX_DAYS 366000
+
+/*
+** Equation of time (apparent minus mean solar time, hours) at 00:00 UT of each day in a range,
+** from sunriset()'s transit at longitude 0. The range grows to cover whatever is converted.
+*/
+typedef struct
+{
+  targetStruct        target;    // Engine, with latitude and longitude 0
+  long long           firstDay;  // Days since 1970 of equation[0]
+  std::vector<double> equation;
+} solarTimeCacheStruct;
+
+void solartime_init (solarTimeCacheStruct *pCache, const targetStruct *pTarget);
+
+/*
+** Convert pCount times (seconds since 1970 UTC) to local apparent solar time (hours, 0 to 24) and
+** hour angle (degrees, -180 to 180, negative before transit). Longitudes are per row, or all
+** pLongitude if pLongitudes is NULL. Degrees E. False if the times span too many days.
+*/
+boolean solartime_convert
+( solarTimeCacheStruct *pCache
+, const double         *pTimes
+, const double         *pLongitudes
+, double                pLongitude
+, size_t                pCount
+, double               *pSolarTime
+, double               *pHourAngle
+);
+
+/*
+** 'solartime': for each "YYYY-MM-DDTHH:MM[:SS] [[latitude] longitude]" line, "time,solar time,hour
+** angle". False if a batch spanned too many days to convert, or the output could not be written.
+*/
+boolean run_solartime (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+** stream.cpp - pipelined query mode
+**
+** Three stages, each on its own thread, joined by bounded single-producer/single-consumer rings:
+**
+**   parser  -> reads and parses stdin lines into queries
+**   compute -> takes queries in batches, computes one ephemeris per distinct date in the batch
+**   writer  -> writes answers, in query order, to stdout
+**
+** Memory use is bounded by the ring capacities, however long the input is.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "ring.h"
+#include "sites.h"
+#include "stream.h"
+
+#define STREAM_RING_SIZE 4096
+#define STREAM_BATCH     1024
+
+typedef enum
+{ QUERY_POLL
+, QUERY_LIST
+, QUERY_NEXT
+, QUERY_ERROR                  // Unparsable line, text holds the error
+, QUERY_END                    // End of input
+} QueryType;
+
+typedef struct
+{
+  QueryType    type;
+  unsigned int count;          // Days, for QUERY_LIST
+  targetStruct target;
+  std::string  text;
+} queryStruct;
+
+typedef struct
+{
+  bool        end;
+  std::string text;
+} answerStruct;
+
+typedef struct
+{
+  targetStruct             *defaults;
+  const siteListStruct     *sites;     // Indexed, for "site=NAME". NULL without a site file
+  spscRing<queryStruct>    *queries;
+  spscRing<answerStruct>   *answers;
+} streamStruct;
+
+/*
+** >>>>> Parser stage <<<<<
+*/
+
+static boolean parseQuery (const targetStruct *pDefaults, const siteListStruct *pSites, char *pLine, queryStruct *pQuery)
+{
+  pQuery->target = *pDefaults;
+  pQuery->target.upDown = UPDOWN_NOT_SET;
+  pQuery->count  = 1;
+
+  char *save = NULL;
+  char *token = strtok_r (pLine, " \t\r\n", &save);
+  if (!token) return false;
+  myToLower (token);
+
+       if (!strcmp (token, "poll")) pQuery->type = QUERY_POLL;
+  else if (!strcmp (token, "next")) pQuery->type = QUERY_NEXT;
+  else if (!strcmp (token, "list")) pQuery->type = QUERY_LIST;
+  else
+  { pQuery->type = QUERY_ERROR;
+    pQuery->text = std::string ("ERROR Unknown query: ") + token;
+    return true;
+  }
+
+  targetStruct *target = &pQuery->target;
+  while ((token = strtok_r (NULL, " \t\r\n", &save)) != NULL)
+  {
+    /* Site names keep their case */
+    if (!strncmp (token, "site=", 5))
+    { const siteStruct *site = pSites ? find_site (pSites, token + 5, strlen (token + 5)) : NULL;
+      if (!site)
+      { pQuery->type = QUERY_ERROR;
+        pQuery->text = std::string ("ERROR Unknown site: ") + (token + 5);
+        return true;
+      }
+      target->latitude  = site->latitude;
+      target->longitude = site->longitude;
+      if (site->engine != ENGINE_NOT_SET) target->engine = site->engine;
+      continue;
+    }
+
+    myToLower (token);
+    long long days;
+    double    hours;
+
+    if (pQuery->type == QUERY_LIST && pQuery->count == 1 && myIsNumber (token) && strlen (token) < 5)
+      pQuery->count = atoi (token);
+    else if (parseIsoTime (token, &days, &hours))
+    { target->daysSince2000 = days - DAYS_2000_JAN_0;
+      civilFromDaysSince2000 (target->daysSince2000, &target->year, &target->month, &target->dayOfMonth);
+      if (strlen (token) > 10) target->nowTime = hours;
+    }
+    else if (!strcmp (token, "daylight"))     target->twilightAngle = TWILIGHT_ANGLE_DAYLIGHT;
+    else if (!strcmp (token, "civil"))        target->twilightAngle = TWILIGHT_ANGLE_CIVIL;
+    else if (!strcmp (token, "nautical"))     target->twilightAngle = TWILIGHT_ANGLE_NAUTICAL;
+    else if (!strcmp (token, "astronomical")) target->twilightAngle = TWILIGHT_ANGLE_ASTRONOMICAL;
+    else if (!strcmp (token, "angle"))
+    { char *angle = strtok_r (NULL, " \t\r\n", &save);
+      if (!angle || !myIsSignedFloat (angle))
+      { pQuery->type = QUERY_ERROR;
+        pQuery->text = "ERROR Angle expected";
+        return true;
+      }
+      target->twilightAngle = atof (angle);
+    }
+    else if (!strcmp (token, "fast"))         target->engine = ENGINE_FAST;
+    else if (!strcmp (token, "noaa"))         target->engine = ENGINE_NOAA;
+    else if (!strcmp (token, "rise") || !strcmp (token, "sunrise")) target->upDown = UPDOWN_SUNRISE;
+    else if (!strcmp (token, "set")  || !strcmp (token, "sunset"))  target->upDown = UPDOWN_SUNSET;
+    else if (isBearing (target, token)) {}
+    else if (isOffset  (target, token)) {}
+    else
+    { pQuery->type = QUERY_ERROR;
+      pQuery->text = std::string ("ERROR Unknown argument: ") + token;
+      return true;
+    }
+  }
+  return true;
+}
+
+static void parserStage (streamStruct *pStream)
+{
+  char  *line = NULL;
+  size_t size = 0;
+
+  while (getline (&line, &size, stdin) != -1)
+  { queryStruct query;
+    if (!parseQuery (pStream->defaults, pStream->sites, line, &query)) continue; /* Blank line */
+    pStream->queries->push (query);
+  }
+  free (line);
+
+  queryStruct end;
+  end.type = QUERY_END;
+  pStream->queries->push (end);
+}
+
+/*
+** >>>>> Compute stage <<<<<
+*/
+
+static void appendDay (std::string *pText, targetStruct *pTarget)
+{
+  char buffer[64];
+  snprintf (buffer, sizeof (buffer), "%4.4u-%2.2u-%2.2u,", pTarget->year, pTarget->month, pTarget->dayOfMonth);
+  pText->append (buffer);
+
+  if (pTarget->dayType == DAYTYPE_NORMAL)
+  { double rise = getOffsetRiseTime (pTarget), set = getOffsetSetTime (pTarget);
+    snprintf (buffer, sizeof (buffer), "%2.2d:%2.2d,%2.2d:%2.2d,normal"
+             , hours (rise), minutes (rise), hours (set), minutes (set));
+    pText->append (buffer);
+  }
+  else if (pTarget->dayType == DAYTYPE_POLAR_DAY) pText->append ("--:--,--:--,polar-day");
+  else                                            pText->append ("--:--,--:--,polar-night");
+}
+
+/* Next offset rise or set (either, unless the query said which) after the query's time */
+static void answerNext (queryStruct *pQuery, const ephemerisStruct *pEphemeris, std::string *pText)
+{
+  targetStruct *target = &pQuery->target;
+  double now = target->nowTime;
+
+  for (int day=0; day <= 400; day++)
+  {
+    if (day == 0) sunriset_ephemeris (target, pEphemeris);
+    else          sunriset (target);
+
+    if (target->dayType == DAYTYPE_NORMAL)
+    { double rise = getOffsetRiseTime (target) + day * 24.0;
+      double set  = getOffsetSetTime  (target) + day * 24.0;
+      boolean useRise = target->upDown != UPDOWN_SUNSET  && rise > now;
+      boolean useSet  = target->upDown != UPDOWN_SUNRISE && set  > now;
+
+      if (useRise || useSet)
+      { boolean isRise = useRise && (!useSet || rise < set);
+        double  event  = isRise ? rise : set;
+        char    iso[32], buffer[96];
+        formatIsoTime (iso, sizeof (iso), target->daysSince2000 - day + DAYS_2000_JAN_0, event);
+        snprintf (buffer, sizeof (buffer), "%s %s %.0f", isRise ? "rise" : "set", iso, (event - now) * 3600.0);
+        pText->append (buffer);
+        return;
+      }
+    }
+    target->daysSince2000++;
+  }
+  pText->append ("NONE");
+}
+
+static void answerQuery (queryStruct *pQuery, const ephemerisStruct *pEphemeris, std::string *pText)
+{
+  targetStruct *target = &pQuery->target;
+
+  switch (pQuery->type)
+  {
+  case QUERY_POLL:
+    sunriset_ephemeris (target, pEphemeris);
+    pText->append (poll (target) == EXIT_DAY ? "DAY" : "NIGHT");
+    break;
+  case QUERY_LIST:
+    for (unsigned int day=0; day < pQuery->count; day++)
+    { if (day == 0) sunriset_ephemeris (target, pEphemeris);
+      else          sunriset (target);
+      if (day > 0) pText->push_back (' ');
+      appendDay (pText, target);
+      target->daysSince2000++;
+      civilFromDaysSince2000 (target->daysSince2000, &target->year, &target->month, &target->dayOfMonth);
+    }
+    break;
+  case QUERY_NEXT:
+    answerNext (pQuery, pEphemeris, pText);
+    break;
+  default:
+    pText->append (pQuery->text);
+  }
+}
+
+static void computeStage (streamStruct *pStream)
+{
+  std::vector<queryStruct>  batch (STREAM_BATCH);
+  std::vector<answerStruct> answers (STREAM_BATCH);
+  std::vector<size_t>       order (STREAM_BATCH);
+  boolean end = false;
+
+  while (!end)
+  {
+    /* Wait for one query, then take whatever else is already queued */
+    size_t count = 0;
+    pStream->queries->pop (batch[count++]);
+    while (count < STREAM_BATCH && batch[count-1].type != QUERY_END && pStream->queries->tryPop (batch[count])) count++;
+    if (batch[count-1].type == QUERY_END) { end = true; count--; }
+
+    /* Group by date, so each date's ephemeris is computed once */
+    for (size_t i=0; i < count; i++) order[i] = i;
+    std::sort (order.begin (), order.begin () + count, [&batch](size_t a, size_t b)
+               { return batch[a].target.daysSince2000 < batch[b].target.daysSince2000; });
+
+    ephemerisStruct ephemeris;
+    boolean haveEphemeris = false;
+    for (size_t k=0; k < count; k++)
+    { queryStruct *query = &batch[order[k]];
+      if (!haveEphemeris || ephemeris.days != query->target.daysSince2000)
+      { sun_ephemeris (query->target.daysSince2000, &ephemeris);
+        haveEphemeris = true;
+      }
+      answers[order[k]].end = false;
+      answers[order[k]].text.clear ();
+      answerQuery (query, &ephemeris, &answers[order[k]].text);
+    }
+
+    for (size_t i=0; i < count; i++) pStream->answers->push (answers[i]);
+  }
+
+  answerStruct last;
+  last.end = true;
+  pStream->answers->push (last);
+}
+
+/*
+** >>>>> Writer stage <<<<<
+*/
+
+static void writerStage (streamStruct *pStream)
+{
+  answerStruct answer;
+  for (;;)
+  { pStream->answers->pop (answer);
+    if (answer.end) break;
+    answer.text.push_back ('\n');
+    fwrite (answer.text.data (), 1, answer.text.size (), stdout);
+    /* Flush whenever we have caught up, so interactive use sees its answers */
+    if (pStream->answers->empty ()) fflush (stdout);
+  }
+  fflush (stdout);
+}
+
+void run_stream (targetStruct *pTarget)
+{
+  spscRing<queryStruct>  queries (STREAM_RING_SIZE);
+  spscRing<answerStruct> answers (STREAM_RING_SIZE);
+
+  siteListStruct sites;
+  memset (&sites, 0, sizeof (sites));
+  if (pTarget->siteFile && (!load_sites (pTarget->siteFile, &sites) || !index_sites (&sites))) return;
+
+  streamStruct stream;
+  stream.defaults = pTarget;
+  stream.sites    = pTarget->siteFile ? &sites : NULL;
+  stream.queries  = &queries;
+  stream.answers  = &answers;
+
+  std::thread parser  (parserStage,  &stream);
+  std::thread compute (computeStage, &stream);
+  writerStage (&stream);
+
+  parser.join ();
+  compute.join ();
+  free_sites (&sites);
+}
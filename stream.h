@@ -0,0 +1,15 @@
+#include "sunwait.h"
+
+#ifndef STREAM_H
+  #define STREAM_H
+
+/*
+** Answer newline-delimited queries from stdin, in order, on stdout. One query per line:
+**
+**   poll|next|list [X] [YYYY-MM-DD[THH:MM[:SS]]] [latitude longitude] [twilight] [rise|set] [offset]
+**
+** Anything not given on the line is taken from pTarget (the command line).
+*/
+void run_stream (targetStruct *pTarget);
+
+#endif
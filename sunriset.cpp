@@ -12,6 +12,10 @@
 #include <math.h>
 #include "sunwait.h"
 #include "sunriset.h"
+#include "days.h"
+#include "horizon.h"
+#include "noaa.h"
+#include "cellcache.h"
 
 using namespace std;
 
@@ -50,6 +54,137 @@ using namespace std;
 /************************************************************************/
 void sunriset (targetStruct *pTarget)
 {
+  if (pTarget->cache) { cellcache_sunriset (pTarget, NULL); return; }
+  if (pTarget->engine == ENGINE_NOAA) { noaa_sunriset (pTarget); return; }
+
+  ephemerisStruct ephemeris;
+  sun_ephemeris (pTarget->daysSince2000, &ephemeris);
+  sunriset_ephemeris (pTarget, &ephemeris);
+}
+
+/*
+** The parts of sunriset() that do not depend on the site. Sites computed for the same
+** day can share one ephemeris, and skip the costly sunpos() and sun_RA_dec() calls.
+*/
+void sun_ephemeris (double d, ephemerisStruct *pEphemeris)
+{
+  pEphemeris->days  = d;
+  pEphemeris->gmst0 = GMST0 (d);
+  sun_RA_dec (d, &pEphemeris->sra, &pEphemeris->sdec, &pEphemeris->sr);
+}
+
+/*
+** Refinement: rather than the day-start position, use the sun's position at the event itself.
+** Each step re-evaluates sun_RA_dec() at the current estimate and solves the diurnal arc again,
+** until the estimate moves less than REFINE_TOLERANCE hours.
+**
+** Starting from the closed-form time, that takes two or three steps. The correction (refined
+** minus closed-form time) changes little from one day to the next, so a day following a refined
+** day starts from its closed-form time plus the previous day's correction, and typically
+** converges on the first step.
+*/
+#define REFINE_TOLERANCE      (1.0/3600.0)
+#define REFINE_MAX_ITERATIONS 8
+
+static boolean refineEvent (targetStruct *pTarget, const ephemerisStruct *pEphemeris, double pDirection, double *pTime)
+{
+  double time = *pTime;
+  for (int i=0; i < REFINE_MAX_ITERATIONS; i++)
+  { double sra, sdec, sr;
+    sun_RA_dec (pEphemeris->days + time / 24.0, &sra, &sdec, &sr);
+    pTarget->refineIterations++;
+
+    double altit = pTarget->twilightAngle;
+    if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altit -= 0.2666 / sr;
+
+    double cost = (sind(altit) - sind(pTarget->latitude) * sind(sdec)) / (cosd(pTarget->latitude) * cosd(sdec));
+    if (fabs (cost) >= 1.0) return false;
+
+    /* GMST0 less RA is the equation of time, both must be taken at the event */
+    double tsouth = 12.0 - rev180 (revolution (GMST0 (pEphemeris->days + time / 24.0) + 180.0 + pTarget->longitude) - sra) / 15.0;
+    double next   = tsouth + pDirection * acosd (cost) / 15.0;
+
+    /* tsouth is folded into one day, the estimate need not be */
+    next += 24.0 * floor ((time - next) / 24.0 + 0.5);
+
+    boolean converged = fabs (next - time) < REFINE_TOLERANCE;
+    time = next;
+    if (converged) { *pTime = time; return true; }
+  }
+  return false;
+}
+
+static void refineEvents (targetStruct *pTarget, const ephemerisStruct *pEphemeris)
+{
+  /* Warm start from the same or previous day, for the same place and twilight */
+  long long days = (long long) pEphemeris->days;
+  boolean warm = pTarget->refineSeeded == ONOFF_ON
+              && (days == pTarget->refineDay || days == pTarget->refineDay + 1)
+              && pTarget->refineAngle     == pTarget->twilightAngle
+              && pTarget->refineLatitude  == pTarget->latitude
+              && pTarget->refineLongitude == pTarget->longitude;
+
+  double rise = pTarget->riseTime + (warm ? pTarget->riseCorrection : 0.0);
+  double set  = pTarget->setTime  + (warm ? pTarget->setCorrection  : 0.0);
+  pTarget->refineEvents += 2;
+
+  /* Close to polar day or night, the event may have no crossing: keep the closed form */
+  if (!refineEvent (pTarget, pEphemeris, -1.0, &rise) || !refineEvent (pTarget, pEphemeris, +1.0, &set))
+  { pTarget->refineSeeded = ONOFF_OFF;
+    return;
+  }
+
+  pTarget->refineSeeded    = ONOFF_ON;
+  pTarget->refineDay       = days;
+  pTarget->refineAngle     = pTarget->twilightAngle;
+  pTarget->refineLatitude  = pTarget->latitude;
+  pTarget->refineLongitude = pTarget->longitude;
+  pTarget->riseCorrection  = rise - pTarget->riseTime;
+  pTarget->setCorrection   = set  - pTarget->setTime;
+  pTarget->riseTime = rise;
+  pTarget->setTime  = set;
+}
+
+/*
+** The same for the skyline: each crossing is solved again with the sun's position at the current
+** estimate, until it moves less than REFINE_TOLERANCE hours. There is no warm start, since the
+** skyline makes the correction change from day to day. If the sun stops crossing on the way, the
+** last time found stands.
+*/
+static void refineHorizonEvent (targetStruct *pTarget, const ephemerisStruct *pEphemeris, double pTransit, boolean pRise)
+{
+  double time = pRise ? pTarget->riseTime : pTarget->setTime;
+  pTarget->refineEvents++;
+  for (int i=0; i < REFINE_MAX_ITERATIONS; i++)
+  { ephemerisStruct ephemeris;
+    sun_ephemeris (pEphemeris->days + time / 24.0, &ephemeris);
+    pTarget->refineIterations++;
+
+    double altit = pTarget->twilightAngle;
+    if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altit -= 0.2666 / ephemeris.sr;
+    double tsouth = 12.0 - rev180 (revolution (ephemeris.gmst0 + 180.0 + pTarget->longitude) - ephemeris.sra) / 15.0;
+    tsouth += 24.0 * floor ((pTransit - tsouth) / 24.0 + 0.5);
+
+    targetStruct result = *pTarget;
+    horizon_sunriset (&result, &ephemeris, altit, tsouth);
+    if (result.dayType != DAYTYPE_NORMAL) break;
+
+    double next = pRise ? result.riseTime : result.setTime;
+    boolean converged = fabs (next - time) < REFINE_TOLERANCE;
+    time = next;
+    if (converged) break;
+  }
+  if (pRise) pTarget->riseTime = time;
+  else       pTarget->setTime  = time;
+}
+
+void sunriset_ephemeris (targetStruct *pTarget, const ephemerisStruct *pEphemeris)
+{
+  if (pTarget->cache) { cellcache_sunriset (pTarget, pEphemeris); return; }
+
+  /* The precise engine cannot share a start-of-day ephemeris */
+  if (pTarget->engine == ENGINE_NOAA) { noaa_sunriset (pTarget); return; }
+
   double sr;         /* solar distance, astronomical units */
   double sra;        /* sun's right ascension */
   double sdec;       /* sun's declination */
@@ -60,10 +195,12 @@ void sunriset (targetStruct *pTarget)
   double altit;      /* sun's altitude: angle to the sun relative to the mathematical (flat-earth) horizon */
 
   /* compute local sideral time of this moment. */
-  sidtime = revolution (GMST0(pTarget->daysSince2000) + 180.0 + pTarget->longitude);
+  sidtime = revolution (pEphemeris->gmst0 + 180.0 + pTarget->longitude);
 
-  /* compute sun's ra + decl at this moment */
-  sun_RA_dec (pTarget->daysSince2000, &sra, &sdec, &sr );
+  /* sun's ra + decl at this moment */
+  sra  = pEphemeris->sra;
+  sdec = pEphemeris->sdec;
+  sr   = pEphemeris->sr;
 
   /* compute time when sun is at south - in hours GMT. "12.00" == noon. "15" == 180degrees/12hours */
   tsouth = 12.0 - rev180(sidtime - sra)/15.0;
@@ -88,6 +225,9 @@ void sunriset (targetStruct *pTarget)
     pTarget->riseTime = tsouth - t;
     pTarget->noonTime = tsouth;
     pTarget->setTime  = tsouth + t;
+
+    /* The skyline's own crossings are refined below instead */
+    if (pTarget->refine == ONOFF_ON && !pTarget->horizon) refineEvents (pTarget, pEphemeris);
   }
   else
   { pTarget->dayType = (cost>=1.0) ? DAYTYPE_POLAR_NIGHT : DAYTYPE_POLAR_DAY ;
@@ -97,6 +237,178 @@ void sunriset (targetStruct *pTarget)
     pTarget->noonTime = tsouth;
     pTarget->setTime  = NOT_SET;
   }
+
+  /* Local skyline, instead of the mathematical horizon */
+  if (pTarget->horizon)
+  { horizon_sunriset (pTarget, pEphemeris, altit, tsouth);
+    if (pTarget->refine == ONOFF_ON && pTarget->dayType == DAYTYPE_NORMAL)
+    { refineHorizonEvent (pTarget, pEphemeris, tsouth, true);
+      refineHorizonEvent (pTarget, pEphemeris, tsouth, false);
+    }
+  }
+}
+
+/*
+** Sun's altitude and azimuth (clockwise from North), degrees, at pHours GMT on the ephemeris' day.
+** Like sunriset(), the day's right ascension and declination are used for the whole day.
+*/
+void sun_alt_az (const ephemerisStruct *pEphemeris, double pLatitude, double pLongitude, double pHours, double *pAltitude, double *pAzimuth)
+{
+  double hourAngle = pEphemeris->gmst0 + 15.0 * pHours + pLongitude - pEphemeris->sra;
+  double sinH = sind (hourAngle), cosH = cosd (hourAngle);
+  double sinLat = sind (pLatitude), cosLat = cosd (pLatitude);
+  double sinDec = sind (pEphemeris->sdec), cosDec = cosd (pEphemeris->sdec);
+
+  *pAltitude = asind (sinLat * sinDec + cosLat * cosDec * cosH);
+  *pAzimuth  = revolution (atan2d (sinH * cosDec, cosH * cosDec * sinLat - sinDec * cosLat) + 180.0);
+}
+
+/*
+** Diurnal arc (hours from transit) to reach an altitude, as in sunriset().
+** Returns -1 if the sun stays below it all day, 12 if it stays above.
+*/
+static double diurnalArc (double pLatitude, double pDeclination, double pAltitude)
+{
+  double cost = (sind(pAltitude) - sind(pLatitude) * sind(pDeclination)) / (cosd(pLatitude) * cosd(pDeclination));
+  if (cost >=  1.0) return -1.0;
+  if (cost <= -1.0) return 12.0;
+  return acosd(cost)/15.0;
+}
+
+/* What clearance() needs, worked out once per day rather than per evaluation */
+typedef struct
+{
+  const horizonStruct *horizon;
+  double altit;
+  double hourAngle0;  /* Hour angle at 0h GMT, degrees */
+  double sinLat, cosLat, sinDec, cosDec;
+  double maxRate;     /* Fastest the clearance can grow, degrees per hour */
+} clearanceStruct;
+
+/* Height of the sun above the skyline plus the twilight altitude, degrees. Positive: clear of it */
+static double clearance (const clearanceStruct *pClearance, double pHours)
+{
+  double hourAngle = pClearance->hourAngle0 + 15.0 * pHours;
+  double sinH = sind (hourAngle), cosH = cosd (hourAngle);
+  double altitude = asind (pClearance->sinLat * pClearance->sinDec + pClearance->cosLat * pClearance->cosDec * cosH);
+  double azimuth  = atan2d (sinH * pClearance->cosDec, cosH * pClearance->cosDec * pClearance->sinLat - pClearance->sinDec * pClearance->cosLat) + 180.0;
+  return altitude - pClearance->altit - horizon_elevation (pClearance->horizon, azimuth);
+}
+
+/*
+** Search from pFrom toward pTo (either direction) for the first time the sun is clear of the
+** skyline, then refine to a second. Returns false if it never clears.
+** While hidden by c degrees, the sun cannot clear within c/maxRate hours, so the search
+** skips ahead by that much: far when deep behind the skyline, finely close to the crossing.
+*/
+static boolean findClearing (const clearanceStruct *pClearance, double pFrom, double pTo, double *pTime)
+{
+  const double minimumStep = 1.0 / 60.0;
+  double direction = (pTo >= pFrom) ? 1.0 : -1.0;
+  double hidden = pFrom;
+  double t = pFrom;
+
+  for (;;)
+  { double c = clearance (pClearance, t);
+    if (c > 0)
+    { if (t == pFrom) { *pTime = pFrom; return true; }
+      /* Illinois false position between the last hidden and first clear times */
+      double clear = t, cClear = c;
+      double cHidden = clearance (pClearance, hidden);
+      int    side = 0;
+      while (fabs (clear - hidden) > 1.0 / 3600.0)
+      { double middle = (hidden * cClear - clear * cHidden) / (cClear - cHidden);
+        double cMiddle = clearance (pClearance, middle);
+        if (cMiddle > 0) { clear  = middle; cClear  = cMiddle; if (side == -1) cHidden /= 2; side = -1; }
+        else             { hidden = middle; cHidden = cMiddle; if (side == +1) cClear  /= 2; side = +1; }
+        if (fabs (cMiddle) < 1e-4) { clear = middle; break; }
+      }
+      *pTime = clear;
+      return true;
+    }
+    if (t == pTo) return false;
+    hidden = t;
+
+    double step = -c / pClearance->maxRate;
+    t += direction * (step > minimumStep ? step : minimumStep);
+    if ((t - pTo) * direction > 0) t = pTo;
+  }
+}
+
+/*
+** Replace the flat-horizon rise/set with the times the sun clears, and drops behind, the skyline.
+** The sun must be between the skyline's lowest and highest points when it crosses, so the
+** closed-form arc for the lowest bounds the search, and the arc for the highest tells polar day.
+*/
+void horizon_sunriset (targetStruct *pTarget, const ephemerisStruct *pEphemeris, double pAltit, double pTransit)
+{
+  const horizonStruct *horizon = pTarget->horizon;
+  double outer = diurnalArc (pTarget->latitude, pEphemeris->sdec, pAltit + horizon->lowest);
+  double inner = diurnalArc (pTarget->latitude, pEphemeris->sdec, pAltit + horizon->highest);
+
+  clearanceStruct context;
+  context.horizon    = horizon;
+  context.altit      = pAltit;
+  context.hourAngle0 = pEphemeris->gmst0 + pTarget->longitude - pEphemeris->sra;
+  context.sinLat     = sind (pTarget->latitude);
+  context.cosLat     = cosd (pTarget->latitude);
+  context.sinDec     = sind (pEphemeris->sdec);
+  context.cosDec     = cosd (pEphemeris->sdec);
+
+  /*
+  ** Altitude changes by 15*cos(lat)*sin(azimuth) degrees an hour, azimuth by
+  ** 15*(sin(lat) - cos(lat)*tan(altitude)*cos(azimuth)), and the skyline by at most 'steepest'
+  ** per degree of azimuth. Together they bound how fast the clearance can grow. Within the bracket
+  ** searched the sun is no lower than the lowest skyline allows, less a degree for the padding, or
+  ** if the bracket is the whole day, than lower culmination; |tan| peaks at one end of the range.
+  */
+  double lowestAltitude = asind (context.sinLat * context.sinDec - context.cosLat * context.cosDec);
+  if (outer < 12.0) lowestAltitude = fmax (lowestAltitude, pAltit + horizon->lowest - 1.0);
+  lowestAltitude = fmax (lowestAltitude, -80.0);
+  double highestAltitude = fmin (pAltit + horizon->highest + 1.0, 80.0);
+  double steepestTan     = fmax (fabs (tand (lowestAltitude)), fabs (tand (highestAltitude)));
+  context.maxRate = 15.0 * ( context.cosLat
+                           + horizon->steepest * (fabs (context.sinLat) + context.cosLat * steepestTan)
+                           ) + 1e-6;
+
+  pTarget->riseTime = NOT_SET;
+  pTarget->setTime  = NOT_SET;
+
+  if (outer < 0)
+  { pTarget->dayType = DAYTYPE_POLAR_NIGHT;
+    return;
+  }
+  if (inner >= 12.0)
+  { pTarget->dayType = DAYTYPE_POLAR_DAY;
+    return;
+  }
+
+  /* Widen the bracket a little, the crossing may sit right on its edge */
+  const double pad = 1.0 / 60.0;
+  outer = (outer + pad < 12.0) ? outer + pad : 12.0;
+
+  /*
+  ** The first time the sun clears the skyline, searching on from the start of the bracket, and the
+  ** last, searching back from its end. The skyline may hide the sun at transit (a building due
+  ** south) and still leave it clear to either side, so the whole bracket is searched, not just up to
+  ** transit; the sun may also drop behind the skyline in between.
+  */
+  double rise = pTransit, set = pTransit;
+  if (!findClearing (&context, pTransit - outer, pTransit + outer, &rise))
+  { pTarget->dayType = DAYTYPE_POLAR_NIGHT;
+    return;
+  }
+  findClearing (&context, pTransit + outer, rise, &set);
+
+  /* Clear of the skyline even at lower culmination */
+  if (outer >= 12.0 && rise == pTransit - outer && set == pTransit + outer)
+  { pTarget->dayType = DAYTYPE_POLAR_DAY;
+    return;
+  }
+
+  pTarget->dayType  = DAYTYPE_NORMAL;
+  pTarget->riseTime = rise;
+  pTarget->setTime  = set;
 }
 
 void sunpos (double d, double *lon, double *r)
@@ -219,33 +531,19 @@ int hours    (double d) { return myTrunc(d); }
 int minutes  (double d) { return myTrunc(fmod(myAbs(d)*60,60)); }
 int seconds  (double d) { return myTrunc(fmod(myAbs(d)*3600,60)); }
 
-unsigned int daysSince2000 (unsigned int pYear, unsigned int pMonth, unsigned int pDay)
-{ 
-  unsigned int yearsSince2000 = pYear - 2000;
-
-  unsigned int leapDaysSince2000 
-    = (unsigned int) floor (yearsSince2000/4)        /* Every evenly divisible 4 years is a leap-year */
-    - (unsigned int) floor (yearsSince2000/100)      /* Except centuries, unless evenly diviable by 400 */
-    + (unsigned int) floor (yearsSince2000/400) +1;  /* 2000 itself was a leap year with the 400 rule */;
-
-  unsigned int monthDays = 0;
-  switch (pMonth)
-  { case  1: monthDays = 0;  break;
-    case  2: monthDays = 31; break;
-    case  3: monthDays = 31+28; break;
-    case  4: monthDays = 31+28+31; break;
-    case  5: monthDays = 31+28+31 +30; break;
-    case  6: monthDays = 31+28+31 +30+31; break;
-    case  7: monthDays = 31+28+31 +30+31+30; break;
-    case  8: monthDays = 31+28+31 +30+31+30 +31; break;
-    case  9: monthDays = 31+28+31 +30+31+30 +31+31; break;
-    case 10: monthDays = 31+28+31 +30+31+30 +31+31+30; break;
-    case 11: monthDays = 31+28+31 +30+31+30 +31+31+30 +31; break;
-    case 12: monthDays = 31+28+31 +30+31+30 +31+31+30 +31+30; break;
-    default: printf ("Error: Number of month is out of range\n");
-  }
-
-  return (yearsSince2000 * 365) + leapDaysSince2000 + monthDays + pDay -1; /* -1 : Don't include today in count */
+/*
+** Days since 2000 Jan 0.0 (i.e. 2000-01-01 is day 1), as used by sun_RA_dec() and GMST0().
+** Signed, so dates before 2000 are negative.
+*/
+long long daysSince2000 (long long pYear, unsigned int pMonth, unsigned int pDay)
+{
+  if (pMonth < 1 || pMonth > 12) printf ("Error: Number of month is out of range\n");
+  return daysFromCivil (pYear, pMonth, pDay) - DAYS_2000_JAN_0;
 }
 
-
+void civilFromDaysSince2000 (long long pDays, unsigned int *pYear, unsigned int *pMonth, unsigned int *pDay)
+{
+  long long year;
+  civilFromDays (pDays + DAYS_2000_JAN_0, &year, pMonth, pDay);
+  *pYear = (unsigned int) year;
+}
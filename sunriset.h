@@ -1,4 +1,8 @@
 #include "sunwait.h"
+
+#ifndef SUNRISET_H
+  #define SUNRISET_H
+
 /* Sunrise/set is considered to occur when the Sun's upper limb (upper edge) is 50 arc minutes below the horizon */
 /* (this accounts for the refraction of the Earth's atmosphere). */
 /* Civil twilight starts/ends when the Sun's center is 6 degrees below the horizon. */
@@ -26,7 +30,21 @@
  #define PI 3.1415926535897932384
 #endif
 
+/* The sun's position at the start of one day, shared by every site computed for that day */
+typedef struct
+{
+  double days;       /* Days since 2000 Jan 0.0 */
+  double gmst0;      /* GMST0(days), degrees */
+  double sra;        /* Right ascension, degrees */
+  double sdec;       /* Declination, degrees */
+  double sr;         /* Distance, astronomical units */
+} ephemerisStruct;
+
 void sunriset (targetStruct* pTarget);
+void sun_ephemeris (double d, ephemerisStruct *pEphemeris);
+void sunriset_ephemeris (targetStruct *pTarget, const ephemerisStruct *pEphemeris);
+void sun_alt_az (const ephemerisStruct *pEphemeris, double pLatitude, double pLongitude, double pHours, double *pAltitude, double *pAzimuth);
+void horizon_sunriset (targetStruct *pTarget, const ephemerisStruct *pEphemeris, double pAltit, double pTransit);
 double revolution (double x);
 double rev180 (double x);
 double GMST0 (double d);
@@ -34,4 +52,7 @@ void sun_RA_dec (double d, double *RA, double *dec, double *r);
 int hours   (double d);
 int minutes (double d);
 int seconds (double d);
-unsigned int daysSince2000 (unsigned int pYear, unsigned int pMonth, unsigned int pDay);
+long long daysSince2000 (long long pYear, unsigned int pMonth, unsigned int pDay);
+void civilFromDaysSince2000 (long long pDays, unsigned int *pYear, unsigned int *pMonth, unsigned int *pDay);
+
+#endif
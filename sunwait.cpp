@@ -7,11 +7,32 @@
 #include <time.h>
 #include <cstring>
 #include <math.h>
+#include <unistd.h>
 #include "sunwait.h"
 #include "sunriset.h"
 #include "print.h"
-#include <thread>
-#include <chrono>
+#include "terminator.h"
+#include "table.h"
+#include "archive.h"
+#include "track.h"
+#include "solartime.h"
+#include "classify.h"
+#include "curve.h"
+#include "insolation.h"
+#include "multiwait.h"
+#include "stream.h"
+#include "daylight.h"
+#include "aggregate.h"
+#include "bench.h"
+#include "cellcache.h"
+#include "pollcache.h"
+#include "daylit.h"
+#include "await.h"
+#include "sites.h"
+#include "horizon.h"
+#include "days.h"
+#include "clock.h"
+#include "simulate.h"
 
 using namespace std;
 
@@ -37,6 +58,8 @@ using namespace std;
 ** It can be a bit naughty on side-effects.
 */
 targetStruct gTarget;
+horizonStruct gHorizon;
+curveTransferStruct gTransfer;
 
 void print_version ()
 {
@@ -71,13 +94,89 @@ void print_usage ()
   printf ("    poll          Returns immediately. See 'return codes'. Default.\n");
   printf ("    wait          Sleep until specified event occurs. Else exit immediate.\n");
   printf ("    list [X]      Report twilight times for next 'X' days. Default X value: 7.\n");
+  printf ("    terminator [X] Print GeoJSON line where the sun is at the twilight angle,\n");
+  printf ("                  now, using 'X' longitude samples. Default X value: 361.\n");
+  printf ("    table [X]     List times for 'X' days for every site in 'sites' file, as CSV.\n");
+  printf ("                  Default X value: 7.\n");
+  printf ("    stream        Answer queries from standard input, one per line:\n");
+  printf ("                  poll|next|list [X] [YYYY-MM-DD[THH:MM[:SS]]] [lat lon] ...\n");
+  printf ("    index [X]     Index day/night for the target year in 'X' minute steps, then\n");
+  printf ("                  answer DAY/NIGHT for each 'YYYY-MM-DDTHH:MM' on standard input,\n");
+  printf ("                  or daylight minutes for each pair of times. Default X value: 1.\n");
+  printf ("    aggregate     Hours of daylight, civil and nautical twilight per month and\n");
+  printf ("                  for the target year, per site: 'site,period,day,civil,nautical'.\n");
+  printf ("    daylit [X]    For each 'YYYY-MM-DDTHH:MM' (or 'now') on standard input, list\n");
+  printf ("                  'time,site' for sites where the sun is above the twilight angle,\n");
+  printf ("                  or with 'X', 'time,site,rise|set,crossing time' for each\n");
+  printf ("                  crossing in the next 'X' minutes.\n");
+  printf ("    track [FILE]  For a track of 'YYYY-MM-DDTHH:MM[:SS] latitude longitude' fixes\n");
+  printf ("                  in FILE (or standard input), list 'time,rise|set,lat,lon' where\n");
+  printf ("                  the sun crosses the twilight angle along it. FILE must exist\n");
+  printf ("                  or contain a '/'.\n");
+  printf ("    solartime     For each 'YYYY-MM-DDTHH:MM[:SS] [[latitude] longitude]' on\n");
+  printf ("                  standard input, print 'time,HH:MM:SS,hour angle': local apparent\n");
+  printf ("                  solar time, and degrees from transit. Default: target longitude.\n");
+  printf ("    insolation [X] Extraterrestrial and clear-sky irradiation on the horizontal,\n");
+  printf ("                  Wh/m2, for 'X' days for every site: 'site,date,extra,clear'.\n");
+  printf ("                  With 'hourly', per UT hour with the sun up: 'site,date,HH,...'.\n");
+  printf ("                  Default X value: 365.\n");
+  printf ("    classify      For each time-sorted 'YYYY-MM-DDTHH:MM[:SS] ...' line on standard\n");
+  printf ("                  input, print the line and ',PHASE': DAY, CIVIL, NAUTICAL, ASTRO\n");
+  printf ("                  or NIGHT, by the sun's altitude at that time.\n");
+  printf ("    curve [X]     Brightness schedule for 'X' days for every site, from the sun's\n");
+  printf ("                  altitude through 'transfer': 'site,date,HH:MM,brightness' points\n");
+  printf ("                  to join with straight lines. Default X value: 1.\n");
+  printf ("    compile FILE  Write 'sites' FILE as a compiled catalog, indexed by name, for\n");
+  printf ("                  faster loading and site=NAME lookups.\n");
+  printf ("    archive FILE [X] Write rise and set for 'X' days for every site to compressed\n");
+  printf ("                  archive FILE. Default X value: 365.\n");
+  printf ("    unarchive FILE [X] List archive FILE as 'table' does, all of it or 'X' days\n");
+  printf ("                  from the target date.\n");
+  printf ("    bench [X]     Time both engines over 'X' days for each site (or a world grid),\n");
+  printf ("                  and report the fast engine's error. Default X value: 365.\n");
   printf ("\n");
   printf ("Minor options, any of:\n");
+  printf ("    or, and       Between 'wait' conditions, each with its own place, and its own\n");
+  printf ("                  twilight, rise|set and offset or else the previous condition's.\n");
+  printf ("                  Wait for the first, or every one, still to come, and print\n");
+  printf ("                  'N,time,rise|set' as condition N fires.\n");
   printf ("    [no]report    Print detailed report of twilight times. Default: noreport.\n");
   printf ("    [no]debug     Print extra info and returns in one minute. Default: nodebug.\n");
   printf ("    [no]version   Print the version number. Default: noversion.\n");
   printf ("    [no]help      Print this help. Default: nohelp.\n");
   printf ("    [no]exit      Print 'DAY','NIGHT','OK' or 'ERROR' on exit. Default: noexit.\n");
+  printf ("    [no]binary    Print 'terminator' as binary float pairs. Default: nobinary.\n");
+  printf ("    [no]transition With 'poll', print 'YYYY-MM-DDTHH:MM:SSZ,seconds' for the sun's\n");
+  printf ("                  next rise or set, or NONE. Default: notransition.\n");
+  printf ("    [no]refine    Fast engine: recompute the sun's position at rise and set,\n");
+  printf ("                  seeded from the previous day's result. Default: norefine.\n");
+  printf ("    sites FILE    File of sites, one 'name,latitude,longitude' per line, or a\n");
+  printf ("                  compiled catalog. With 'wait', wait for every site's event:\n");
+  printf ("                  'time,site,rise|set'.\n");
+  printf ("    site=NAME     Use the coordinates of site NAME in 'sites' FILE, or else in\n");
+  printf ("                  the file named by environment variable SUNWAIT_SITES.\n");
+  printf ("    output FILE   Write 'table' to FILE rather than standard output.\n");
+  printf ("    manifest FILE With 'output', keep each site's input hash in FILE, and only\n");
+  printf ("                  recompute sites that changed since, copying the rest.\n");
+  printf ("    direct        With 'output', bypass the page cache (O_DIRECT) where the file\n");
+  printf ("                  system allows it. For exports larger than memory.\n");
+  printf ("    transfer ALT:BRIGHT,...  With 'curve', brightness at sun altitudes (degrees,\n");
+  printf ("                  increasing), linear between them. Default: %s\n", CURVE_TRANSFER);
+  printf ("    maxerror X    With 'curve', most the points may be out by. Default: %.1f\n", CURVE_MAX_ERROR);
+  printf ("    threads X     Threads for multi-site options. Default: one per CPU.\n");
+  printf ("    simulate FROM TO  Replay 'wait' or 'poll' from FROM to TO (YYYY-MM-DDTHH:MM)\n");
+  printf ("                  on a virtual clock, printing when waits fire or polls change.\n");
+  printf ("    speed X       Simulated seconds per real second. Default: 0, flat out.\n");
+  printf ("    step X        Minutes between simulated polls. Default: 1.\n");
+  printf ("    engine fast|noaa  Rise/set algorithm: 'fast', one sun position per day, good to\n");
+  printf ("                  a minute or two, or 'noaa', iterated to seconds. Default: fast.\n");
+  printf ("    cachefile [PATH] Keep 'poll' and 'wait' results for the day in PATH, which\n");
+  printf ("                  must contain a '/', for later runs. Default: %s\n", POLLCACHE_FILE);
+  printf ("    cellcache X   Cache results for 'X' degree cells, interpolating within them.\n");
+  printf ("    cellerror X   Most seconds interpolation may be out by, for the fast engine.\n");
+  printf ("                  Cells it cannot bound, and other engines, are computed exactly.\n");
+  printf ("    horizon FILE  Local skyline, one 'azimuth elevation' (degrees) per line.\n");
+  printf ("                  Rise/set become when the sun clears/drops behind it.\n");
   printf ("\n");
   printf ("Sunrise/sunset. Only useful with major-option: 'wait'. Either:\n");
   printf ("    rise          Wait for the sun to rise past specified twilight & offset.\n");
@@ -94,7 +193,7 @@ void print_usage ()
   printf ("Target date. Only useful with major-options: 'report' or 'list'.\n");
   printf ("    d DD          Set the target Day-of-Month to calculate for. 1 to 31.\n");
   printf ("    m MM          Set the target Month to calculate for. 1 to 12.\n");
-  printf ("    y YYYY        Set the target Year to calculate for. 2000 to 2099.\n");
+  printf ("    y YYYY        Set the target Year to calculate for. 1800 to 2300.\n");
   printf ("\n");
   printf ("Return Codes:\n");
   printf ("    %1d             Exit from 'wait' or 'list', everythings seems OK.\n", EXIT_OK);
@@ -341,6 +440,16 @@ boolean isOffset (targetStruct *pTarget, char* pArg)
   return false; /* Shouldn't get here */
 }
 
+/*
+** Set the target's "now" from a clock reading (seconds since 1970 UTC)
+*/
+void setNowTime (targetStruct *pTarget, double pSeconds)
+{
+  long long days = (long long) floor (pSeconds / 86400.0);
+  pTarget->nowTime = (pSeconds - days * 86400.0) / 3600.0;
+  civilFromDaysSince2000 (days - DAYS_2000_JAN_0, &pTarget->nowYear, &pTarget->nowMonth, &pTarget->nowDayOfMonth);
+}
+
 double getOffsetRiseTime (targetStruct *pTarget)
 { double offset = pTarget->riseTime + pTarget->hourOffset;
   if (offset <  0.00) return 0.0000;
@@ -355,6 +464,39 @@ double getOffsetSetTime (targetStruct *pTarget)
   return offset;
 }
 
+/*
+** Latitude and longitude from a site name, if given, or else the default place. 0 to 360 degrees.
+*/
+static void resolveLocation (targetStruct *pTarget, const char *pSiteName)
+{
+  /* A named site, from the site file or else the catalog named by $SUNWAIT_SITES */
+  if (pSiteName)
+  { const char *catalog = pTarget->siteFile ? pTarget->siteFile : getenv ("SUNWAIT_SITES");
+    siteStruct site;
+    if (!catalog)
+    { printf ("Error: \"site=%s\" needs 'sites FILE' or SUNWAIT_SITES.\n", pSiteName);
+      exit (EXIT_ERROR);
+    }
+    if (!lookup_site (catalog, pSiteName, &site))
+    { printf ("Error: Site not found in %s: %s\n", catalog, pSiteName);
+      exit (EXIT_ERROR);
+    }
+    pTarget->latitude  = site.latitude;
+    pTarget->longitude = site.longitude;
+    if (site.engine != ENGINE_NOT_SET) pTarget->engine = site.engine;
+  }
+
+  if (pTarget->latitude == NOT_SET || pTarget->longitude == NOT_SET)
+  { if (pTarget->debug == ONOFF_ON) printf ("Debug: latitude or longitude not set. Default applied.\n");
+    pTarget->latitude  = 52.952308;
+    pTarget->longitude = 359.048052; /* The Buttercross, Bingham, England */
+  }
+
+  /* Co-ordinates must be in 0 to 360 range */
+  pTarget->latitude  = revolution (pTarget->latitude);
+  pTarget->longitude = revolution (pTarget->longitude);
+}
+
 /*
 ** >>>>> main() <<<<<
 */
@@ -376,45 +518,58 @@ int main(int argc, char *argv[])
   gTarget.debug          = ONOFF_OFF;
   gTarget.exitReport     = ONOFF_OFF;
   gTarget.dayType        = DAYTYPE_NORMAL;
+  gTarget.points         = 361;
+  gTarget.binary         = ONOFF_OFF;
+  gTarget.siteFile       = NULL;
+  gTarget.threads        = 0;
+  gTarget.resolution     = 1.0;
+  gTarget.horizon        = NULL;
+  gTarget.simulate       = ONOFF_OFF;
+  gTarget.speed          = 0.0;
+  gTarget.engine         = ENGINE_FAST;
+  gTarget.refine         = ONOFF_OFF;
+  gTarget.refineSeeded   = ONOFF_OFF;
+  gTarget.cache          = NULL;
+  gTarget.within         = 0;
+  gTarget.compileFile    = NULL;
+  gTarget.archiveFile    = NULL;
+  gTarget.trackFile      = NULL;
+  gTarget.hourly         = ONOFF_OFF;
+  gTarget.transition     = ONOFF_OFF;
+  gTarget.outputFile     = NULL;
+  gTarget.manifestFile   = NULL;
+  gTarget.direct         = ONOFF_OFF;
+  gTarget.transfer       = NULL;
+  gTarget.maxError       = CURVE_MAX_ERROR;
 
   /* Return code */
   int exitCode = EXIT_OK;
 
+  /* Skyline profile, loaded once the arguments have been parsed */
+  const char *horizonFile = NULL;
+  const char *transferText = NULL;
+  double cellDegrees = 0.0, cellError = 5.0;
+  const char *siteName = NULL;
+  const char *cacheFileName = NULL;
+  waitConditionsStruct multiWait;
+  multiWait.all = ONOFF_OFF;
+
   /*
   ** Get current time in GMT
   */
 
-  {
-    struct tm tmNow;
-
-    /* Windows code: Start */
-    //errno_t err;
-    //__int64 ltime;
-    //time (&ltime);
-    //err = _gmtime64_s (&tmNow, &ltime);
-    //if (err) { printf ("Error: Invalid Argument to _gmtime64_s."); }
-    /* Windows code: End */
-
-    ///* Linux code: Start */
-    time_t tt;
-    tt = time (NULL);
-    ctime (&tt);
-    gmtime_r (&tt, &tmNow);
-    ///* Linux code: End */
-
-    gTarget.nowTime        = tmNow.tm_hour + tmNow.tm_min/60.0 + tmNow.tm_sec/3600;
-    gTarget.nowYear        = tmNow.tm_year + 1900;
-    gTarget.nowMonth       = tmNow.tm_mon  + 1;
-    gTarget.nowDayOfMonth  = tmNow.tm_mday;
-    gTarget.year           = gTarget.nowYear;
-    gTarget.month          = gTarget.nowMonth;
-    gTarget.dayOfMonth     = gTarget.nowDayOfMonth;
-  }
+  setNowTime (&gTarget, clock_now ());
+  gTarget.year           = gTarget.nowYear;
+  gTarget.month          = gTarget.nowMonth;
+  gTarget.dayOfMonth     = gTarget.nowDayOfMonth;
 
   /*
   ** Parse command line arguments
   */
 
+  /* Keep the arguments' original case, for file names ... */
+  char **originalArgv = (char **) malloc (argc * sizeof (char *));
+  for (int i=0; i < argc; i++) originalArgv[i] = strdup (argv[i]);
   /* Change to all lowercase, just to make life easier ... */
   myToLower (argc, argv);
   /* Look for debug being activated ... */
@@ -441,6 +596,7 @@ int main(int argc, char *argv[])
     else if   (!strcmp (arg, "nh" )           ||
                !strcmp (arg, "nohelp"))       {} // Ignore
 
+    else if   (!strcmp (arg, "d") && i+1<argc && myIsNumber (argv[i+1])) gTarget.dayOfMonth = atoi (argv [++i]); // Note: "++i", before "d" for debug
     else if   (!strcmp (arg, "d")             ||
                !strcmp (arg, "debug"))        gTarget.debug = ONOFF_ON;
     else if   (!strcmp (arg, "nd")            ||
@@ -464,10 +620,17 @@ int main(int argc, char *argv[])
                !strcmp (arg, "noexit")        ||
                !strcmp (arg, "noexitreport")) gTarget.exitReport = ONOFF_OFF;
 
+    else if   (!strcmp (arg, "b")             ||
+               !strcmp (arg, "binary"))       gTarget.binary = ONOFF_ON;
+    else if   (!strcmp (arg, "nb")            ||
+               !strcmp (arg, "nobinary")      ||
+               !strcmp (arg, "geojson"))      gTarget.binary = ONOFF_OFF;
+    else if   (!strcmp (arg, "refine"))       gTarget.refine = ONOFF_ON;
+    else if   (!strcmp (arg, "norefine"))     gTarget.refine = ONOFF_OFF;
+
     /* If a setting follows flag, process ... NOTE: targetGMT - other "struct tm" fields are probably broken from now on */
     else if   (!strcmp (arg, "y") && i+1<argc && myIsNumber (argv[i+1])) gTarget.year       = atoi (argv [++i]); // Note: "++i"
     else if   (!strcmp (arg, "m") && i+1<argc && myIsNumber (argv[i+1])) gTarget.month      = atoi (argv [++i]); // Note: "++i"
-    else if   (!strcmp (arg, "d") && i+1<argc && myIsNumber (argv[i+1])) gTarget.dayOfMonth = atoi (argv [++i]); // Note: "++i"
 
     else if   (!strcmp (arg, "sun")           ||
                !strcmp (arg, "day")           ||
@@ -503,6 +666,61 @@ int main(int argc, char *argv[])
                !strcmp (arg, "sundown")       ||
                !strcmp (arg, "down"))         gTarget.upDown = UPDOWN_SUNSET;
 
+    else if   (!strcmp (arg, "stream"))       gTarget.function = FUNCTION_STREAM;
+    else if   (!strcmp (arg, "aggregate"))    gTarget.function = FUNCTION_AGGREGATE;
+    else if   (!strcmp (arg, "daylit"))       {
+                                                gTarget.function = FUNCTION_DAYLIT;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.within = atoi (argv [++i]); // Note: ++i
+                                              }
+    else if   (!strcmp (arg, "track"))        {
+                                                gTarget.function = FUNCTION_TRACK;
+                                                if (i+1<argc && (!strcmp (argv[i+1], "-") || strchr (argv[i+1], '/') || access (originalArgv[i+1], R_OK) == 0))
+                                                  gTarget.trackFile = originalArgv [++i]; // Note: ++i
+                                              }
+    else if   (!strcmp (arg, "solartime"))    gTarget.function = FUNCTION_SOLARTIME;
+    else if   (!strcmp (arg, "classify"))     gTarget.function = FUNCTION_CLASSIFY;
+    else if   (!strcmp (arg, "curve"))        {
+                                                gTarget.function = FUNCTION_CURVE;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.list = atoi (argv [++i]); // Note: ++i
+                                                else
+                                                  gTarget.list = 1;
+                                              }
+    else if   (!strcmp (arg, "transfer") && i+1<argc) transferText = argv [++i]; // Note: "++i"
+    else if   (!strcmp (arg, "maxerror") && i+1<argc && myIsSignedFloat (argv[i+1])) gTarget.maxError = atof (argv [++i]); // Note: "++i"
+    else if   (!strcmp (arg, "insolation"))   {
+                                                gTarget.function = FUNCTION_INSOLATION;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.list = atoi (argv [++i]); // Note: ++i
+                                                else
+                                                  gTarget.list = 365;
+                                              }
+    else if   (!strcmp (arg, "hourly"))       gTarget.hourly = ONOFF_ON;
+    else if   (!strcmp (arg, "direct"))       gTarget.direct = ONOFF_ON;
+    else if   (!strcmp (arg, "transition"))   gTarget.transition = ONOFF_ON;
+    else if   (!strcmp (arg, "notransition")) gTarget.transition = ONOFF_OFF;
+    else if   (!strcmp (arg, "bench"))        {
+                                                gTarget.function = FUNCTION_BENCH;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.list = atoi (argv [++i]); // Note: ++i
+                                                else
+                                                  gTarget.list = 365;
+                                              }
+    else if   (!strcmp (arg, "engine") && i+1<argc) {
+                                                     if (!strcmp (argv[i+1], "fast")) gTarget.engine = ENGINE_FAST;
+                                                else if (!strcmp (argv[i+1], "noaa")) gTarget.engine = ENGINE_NOAA;
+                                                else
+                                                { printf ("Error: \"engine\" needs 'fast' or 'noaa': %s\n", argv[i+1]);
+                                                  exit (EXIT_ERROR);
+                                                }
+                                                i++;
+                                              }
+    else if   (!strcmp (arg, "index"))        {
+                                                gTarget.function = FUNCTION_INDEX;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.resolution = atoi (argv [++i]); // Note: ++i
+                                              }
     else if   (!strcmp (arg, "wait"))         gTarget.function = FUNCTION_WAIT;
     else if   (!strcmp (arg, "poll"))         gTarget.function = FUNCTION_POLL;
     else if   (!strcmp (arg, "list")          ||
@@ -513,7 +731,80 @@ int main(int argc, char *argv[])
                                                 else
                                                   gTarget.list = 7;
                                               }
+    else if   (!strcmp (arg, "table"))        {
+                                                gTarget.function = FUNCTION_TABLE;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.list = atoi (argv [++i]); // Note: ++i
+                                                else
+                                                  gTarget.list = 7;
+                                              }
+    else if   (!strcmp (arg, "sites")   && i+1<argc) gTarget.siteFile = originalArgv [++i]; // Note: "++i"
+    else if   (!strcmp (arg, "output")  && i+1<argc) gTarget.outputFile = originalArgv [++i]; // Note: "++i"
+    else if   (!strcmp (arg, "manifest") && i+1<argc) gTarget.manifestFile = originalArgv [++i]; // Note: "++i"
+    else if   (!strncmp (arg, "site=", 5))    siteName = originalArgv [i] + (arg - argv [i]) + 5; /* Names keep their case */
+    else if   (!strcmp (arg, "compile") && i+1<argc) {
+                                                gTarget.function    = FUNCTION_COMPILE;
+                                                gTarget.compileFile = originalArgv [++i]; // Note: "++i"
+                                              }
+    else if   (!strcmp (arg, "archive") && i+1<argc) {
+                                                gTarget.function    = FUNCTION_ARCHIVE;
+                                                gTarget.archiveFile = originalArgv [++i]; // Note: "++i"
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.list = atoi (argv [++i]); // Note: ++i
+                                                else
+                                                  gTarget.list = 365;
+                                              }
+    else if   (!strcmp (arg, "unarchive") && i+1<argc) {
+                                                gTarget.function    = FUNCTION_UNARCHIVE;
+                                                gTarget.archiveFile = originalArgv [++i]; // Note: "++i"
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.list = atoi (argv [++i]); // Note: ++i
+                                                else
+                                                  gTarget.list = 0;
+                                              }
+    else if   ((!strcmp (arg, "simulate") || !strcmp (arg, "-simulate")) && i+2<argc)
+                                              { long long fromDays, toDays;
+                                                double    fromHours, toHours;
+                                                if (!parseIsoTime (argv[i+1], &fromDays, &fromHours) || !parseIsoTime (argv[i+2], &toDays, &toHours))
+                                                { printf ("Error: \"simulate\" needs two times, YYYY-MM-DDTHH:MM: %s %s\n", argv[i+1], argv[i+2]);
+                                                  exit (EXIT_ERROR);
+                                                }
+                                                gTarget.simulate     = ONOFF_ON;
+                                                gTarget.simulateFrom = fromDays * 86400.0 + fromHours * 3600.0;
+                                                gTarget.simulateTo   = toDays   * 86400.0 + toHours   * 3600.0;
+                                                i += 2;
+                                              }
+    else if   ((!strcmp (arg, "speed") || !strcmp (arg, "-speed")) && i+1<argc && myIsSignedFloat (argv[i+1])) gTarget.speed = atof (argv [++i]); // Note: "++i"
+    else if   (!strcmp (arg, "step") && i+1<argc && myIsNumber (argv[i+1])) gTarget.resolution = atoi (argv [++i]); // Note: "++i"
+    else if   (!strcmp (arg, "horizon") && i+1<argc) horizonFile = originalArgv [++i]; // Note: "++i"
+    else if   (!strcmp (arg, "cellcache") && i+1<argc && myIsSignedFloat (argv[i+1])) cellDegrees = atof (argv [++i]); // Note: "++i"
+    else if   (!strcmp (arg, "cachefile"))    {
+                                                if (i+1<argc && strchr (argv[i+1], '/'))
+                                                  cacheFileName = originalArgv [++i]; // Note: ++i
+                                                else
+                                                  cacheFileName = POLLCACHE_FILE;
+                                              }
+    else if   (!strcmp (arg, "cellerror") && i+1<argc && myIsSignedFloat (argv[i+1])) cellError   = atof (argv [++i]); // Note: "++i"
+    else if   (!strcmp (arg, "threads") && i+1<argc && myIsNumber (argv[i+1])) gTarget.threads = atoi (argv [++i]); // Note: "++i"
+    else if   (!strcmp (arg, "terminator"))   {
+                                                gTarget.function = FUNCTION_TERMINATOR;
+                                                if (i+1<argc && myIsNumber (argv[i+1]))
+                                                  gTarget.points = atoi (argv [++i]); // Note: ++i
+                                              }
 
+    else if   (!strcmp (arg, "or") || !strcmp (arg, "and"))
+                                              { /* Next condition: its own place, the rest carried over */
+                                                OnOff all = strcmp (arg, "and") ? ONOFF_OFF : ONOFF_ON;
+                                                if (!multiWait.conditions.empty () && multiWait.all != all)
+                                                { printf ("Error: Conditions can be joined by \"or\" or by \"and\", not both.\n");
+                                                  exit (EXIT_ERROR);
+                                                }
+                                                multiWait.all = all;
+                                                multiwait_add (&multiWait, &gTarget, siteName);
+                                                gTarget.latitude  = NOT_SET;
+                                                gTarget.longitude = NOT_SET;
+                                                siteName = NULL;
+                                              }
     else if   (isBearing (&gTarget, arg)) {} /* Functionality in "isBearing()" */
     else if   (isOffset  (&gTarget, arg)) {} /* Functionality in "isOffset()" */
     else printf ("Error: Unknown command-line argument: %s\n", arg);
@@ -528,8 +819,9 @@ int main(int argc, char *argv[])
   */
 
   if (gTarget.year     < 100 && gTarget.year       >= 0) gTarget.year += 2000;
-  if (gTarget.month      < 1 && gTarget.month      > 12) { printf ("Error: \"Month\" must be between 1 and 12: %u\n", gTarget.month); exit (EXIT_ERROR); }
-  if (gTarget.dayOfMonth < 1 && gTarget.dayOfMonth > 31) { printf ("Error: \"Day of month\" must be between 1 and 31: %u\n", gTarget.dayOfMonth); exit (EXIT_ERROR); }
+  if (gTarget.year  < 1800 || gTarget.year       > 2300) { printf ("Error: \"Year\" must be between 1800 and 2300: %u\n", gTarget.year); exit (EXIT_ERROR); }
+  if (gTarget.month      < 1 || gTarget.month      > 12) { printf ("Error: \"Month\" must be between 1 and 12: %u\n", gTarget.month); exit (EXIT_ERROR); }
+  if (gTarget.dayOfMonth < 1 || gTarget.dayOfMonth > daysInMonth (gTarget.year, gTarget.month)) { printf ("Error: \"Day of month\" must be between 1 and %u: %u\n", daysInMonth (gTarget.year, gTarget.month), gTarget.dayOfMonth); exit (EXIT_ERROR); }
   // The sunset calculator requires the number of days since Jan 0, 2000
   gTarget.daysSince2000 = daysSince2000 (gTarget.year, gTarget.month, gTarget.dayOfMonth);
 
@@ -537,21 +829,83 @@ int main(int argc, char *argv[])
   ** Check: Latitude and Longitude
   */
 
-  if (gTarget.latitude == NOT_SET || gTarget.longitude == NOT_SET)
-  { if (gTarget.debug == ONOFF_ON) printf ("Debug: latitude or longitude not set. Default applied.\n");
-    gTarget.latitude  = 52.952308;
-    gTarget.longitude = 359.048052; /* The Buttercross, Bingham, England */
+  if (!multiWait.conditions.empty () && gTarget.function != FUNCTION_WAIT)
+  { printf ("Error: \"or\" and \"and\" are only for 'wait'.\n");
+    exit (EXIT_ERROR);
   }
 
-  /* Co-ordinates must be in 0 to 360 range */
-  gTarget.latitude  = revolution (gTarget.latitude);
-  gTarget.longitude = revolution (gTarget.longitude);
+  /* Every 'or'/'and' condition, the last being what follows the last separator */
+  if (!multiWait.conditions.empty ())
+  { multiwait_add (&multiWait, &gTarget, siteName);
+    for (waitConditionStruct &condition : multiWait.conditions)
+    { targetStruct target = gTarget;
+      target.latitude  = condition.latitude;
+      target.longitude = condition.longitude;
+      target.engine    = ENGINE_NOT_SET;
+      resolveLocation (&target, condition.siteName);
+      condition.latitude  = target.latitude;
+      condition.longitude = target.longitude;
+      condition.engine    = target.engine;
+    }
+    siteName = NULL;
+  }
+
+  resolveLocation (&gTarget, siteName);
 
   if (gTarget.debug == ONOFF_ON)
   {  printf ("Debug: Co-ordinates - Latitude:  %f\n", gTarget.latitude);
      printf ("Debug: Co-ordinates - Longitude: %f\n", gTarget.longitude);
   }
 
+  if (gTarget.manifestFile && !gTarget.outputFile)
+  { printf ("Error: \"manifest\" needs 'output FILE'.\n");
+    exit (EXIT_ERROR);
+  }
+  if (gTarget.outputFile && gTarget.function != FUNCTION_TABLE)
+  { printf ("Error: \"output\" is only for 'table'.\n");
+    exit (EXIT_ERROR);
+  }
+
+  /*
+  ** Check: Transfer function
+  */
+
+  if (gTarget.function == FUNCTION_CURVE || transferText)
+  { if (!curve_parse_transfer (transferText ? transferText : CURVE_TRANSFER, &gTransfer)) exit (EXIT_ERROR);
+    gTarget.transfer = &gTransfer;
+    if (gTarget.maxError <= 0.0)
+    { printf ("Error: \"maxerror\" must be more than 0.\n");
+      exit (EXIT_ERROR);
+    }
+  }
+
+  /*
+  ** Check: Horizon
+  */
+
+  if (horizonFile)
+  { if (!load_horizon (horizonFile, &gHorizon)) exit (EXIT_ERROR);
+    gTarget.horizon = &gHorizon;
+    if (gTarget.debug == ONOFF_ON) printf ("Debug: Horizon - %.2f to %.2f degrees\n", gHorizon.lowest, gHorizon.highest);
+  }
+
+  /*
+  ** Check: Cell cache
+  */
+
+  if (cellDegrees > 0.0)
+  { if (cellError <= 0.0)
+    { printf ("Error: \"cellerror\" must be more than 0 seconds: %f\n", cellError);
+      exit (EXIT_ERROR);
+    }
+    gTarget.cache = cellcache_create (cellDegrees, cellError);
+    if (gTarget.debug == ONOFF_ON) printf ("Debug: Cell cache - %f degree cells, %.1f seconds error\n", cellDegrees, cellError);
+  }
+  else if (cellDegrees < 0.0)
+  { printf ("Error: \"cellcache\" needs a cell size in degrees: %f\n", cellDegrees);
+    exit (EXIT_ERROR);
+  }
+
   /*
   ** Check: Twilight Angle
   */
@@ -595,6 +949,21 @@ int main(int argc, char *argv[])
     else if (gTarget.function == FUNCTION_USAGE)   printf ("Debug: Function - Usage\n");
     else if (gTarget.function == FUNCTION_VERSION) printf ("Debug: Function - Version\n");
     else if (gTarget.function == FUNCTION_WAIT)    printf ("Debug: Function - Wait\n");
+    else if (gTarget.function == FUNCTION_TERMINATOR) printf ("Debug: Function - Terminator\n");
+    else if (gTarget.function == FUNCTION_TABLE)   printf ("Debug: Function - Table\n");
+    else if (gTarget.function == FUNCTION_STREAM)  printf ("Debug: Function - Stream\n");
+    else if (gTarget.function == FUNCTION_INDEX)   printf ("Debug: Function - Index\n");
+    else if (gTarget.function == FUNCTION_AGGREGATE) printf ("Debug: Function - Aggregate\n");
+    else if (gTarget.function == FUNCTION_BENCH)   printf ("Debug: Function - Bench\n");
+    else if (gTarget.function == FUNCTION_DAYLIT)  printf ("Debug: Function - Daylit\n");
+    else if (gTarget.function == FUNCTION_COMPILE) printf ("Debug: Function - Compile\n");
+    else if (gTarget.function == FUNCTION_ARCHIVE) printf ("Debug: Function - Archive\n");
+    else if (gTarget.function == FUNCTION_UNARCHIVE) printf ("Debug: Function - Unarchive\n");
+    else if (gTarget.function == FUNCTION_TRACK)   printf ("Debug: Function - Track\n");
+    else if (gTarget.function == FUNCTION_SOLARTIME) printf ("Debug: Function - Solar time\n");
+    else if (gTarget.function == FUNCTION_INSOLATION) printf ("Debug: Function - Insolation\n");
+    else if (gTarget.function == FUNCTION_CLASSIFY) printf ("Debug: Function - Classify\n");
+    else if (gTarget.function == FUNCTION_CURVE)   printf ("Debug: Function - Curve\n");
   }
 
   /*
@@ -602,13 +971,29 @@ int main(int argc, char *argv[])
   ** For latitudes near poles, the sun might not pass through specified twilight angle that day.
   */
 
-  sunriset (&gTarget);
+  /* A cron-driven poll or wait can reuse the day's result from an earlier run */
+  if ( cacheFileName && !gTarget.cache && !gTarget.siteFile && gTarget.simulate == ONOFF_OFF
+    && (gTarget.function == FUNCTION_POLL || gTarget.function == FUNCTION_WAIT))
+    pollcache_sunriset (&gTarget, cacheFileName);
+  else
+    sunriset (&gTarget);
 
   // Print out (on standard output) the report about sunrise and sunset times
   if (gTarget.report == ONOFF_ON) generate_report (&gTarget);
 
   // Anything decided on now?
-  if (gTarget.function == FUNCTION_VERSION)
+  if (gTarget.function == FUNCTION_WAIT && !multiWait.conditions.empty ())
+  { exitCode = multi_wait (&gTarget, &multiWait);
+  }
+  else if (gTarget.function == FUNCTION_WAIT && gTarget.siteFile)
+  { run_await (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.simulate == ONOFF_ON && (gTarget.function == FUNCTION_WAIT || gTarget.function == FUNCTION_POLL))
+  { run_simulation (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.function == FUNCTION_VERSION)
   { print_version ();
     exitCode = EXIT_OK;
   }
@@ -620,11 +1005,87 @@ int main(int argc, char *argv[])
   { print_list (&gTarget);
     exitCode = EXIT_OK;
   }
+  else if (gTarget.function == FUNCTION_AGGREGATE)
+  { exitCode = print_aggregate (&gTarget) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_BENCH)
+  { print_bench (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.function == FUNCTION_DAYLIT)
+  { run_daylit (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.function == FUNCTION_COMPILE)
+  { siteListStruct sites;
+    exitCode = EXIT_ERROR;
+    if (!gTarget.siteFile) printf ("Error: \"compile\" needs 'sites FILE'.\n");
+    else if (load_sites (gTarget.siteFile, &sites))
+    { if (compile_sites (&sites, gTarget.compileFile))
+      { if (gTarget.debug == ONOFF_ON) printf ("Debug: Compiled %lu sites to %s\n", (unsigned long) sites.count, gTarget.compileFile);
+        exitCode = EXIT_OK;
+      }
+      free_sites (&sites);
+    }
+  }
+  else if (gTarget.function == FUNCTION_ARCHIVE)
+  { exitCode = write_archive (&gTarget, gTarget.archiveFile) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_UNARCHIVE)
+  { exitCode = print_archive (&gTarget, gTarget.archiveFile, gTarget.list) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_TRACK)
+  { exitCode = run_track (&gTarget) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_SOLARTIME)
+  { exitCode = run_solartime (&gTarget) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_INSOLATION)
+  { exitCode = print_insolation (&gTarget) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_CLASSIFY)
+  { run_classify (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.function == FUNCTION_CURVE)
+  { exitCode = print_curve (&gTarget) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_INDEX)
+  { run_daylight_index (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.function == FUNCTION_STREAM)
+  { run_stream (&gTarget);
+    exitCode = EXIT_OK;
+  }
+  else if (gTarget.function == FUNCTION_TABLE)
+  { exitCode = print_table (&gTarget) ? EXIT_OK : EXIT_ERROR;
+  }
+  else if (gTarget.function == FUNCTION_TERMINATOR)
+  { print_terminator (&gTarget);
+    exitCode = EXIT_OK;
+  }
   else if (gTarget.function == FUNCTION_WAIT)
   { exitCode = wait (&gTarget);
   }
   else if (gTarget.function == FUNCTION_POLL)
   { exitCode = poll (&gTarget);
+    if (gTarget.transition == ONOFF_ON)
+    { double next = next_transition (&gTarget);
+      if (next < 0) printf ("NONE\n");
+      else
+      { char iso[32];
+        long long days = (long long) floor (next / 86400.0);
+        double    now  = (daysSince2000 (gTarget.nowYear, gTarget.nowMonth, gTarget.nowDayOfMonth) + DAYS_2000_JAN_0) * 86400.0 + gTarget.nowTime * 3600.0;
+        formatIsoTime (iso, sizeof (iso), days, (next - days * 86400.0) / 3600.0);
+        printf ("%s,%.0f\n", iso, ceil (next - now));
+      }
+    }
+  }
+
+  if (gTarget.cache)
+  { if (gTarget.debug == ONOFF_ON) print_cellcache (gTarget.cache);
+    cellcache_free (gTarget.cache);
   }
 
   if (gTarget.exitReport == ONOFF_ON)
@@ -653,45 +1114,122 @@ int poll (targetStruct *pTarget)
   return EXIT_NIGHT;
 }
 
-int wait (targetStruct *pTarget)
+/*
+** Seconds from now until the offset rise or set "wait" is looking for. Negative if passed.
+*/
+double wait_seconds (targetStruct *pTarget)
 {
-  int days = daysSince2000 (pTarget->year,    pTarget->month,    pTarget->dayOfMonth)
-           - daysSince2000 (pTarget->nowYear, pTarget->nowMonth, pTarget->nowDayOfMonth);
-
-  if (days < 0) printf ("Debug: Event already passed previous day.\n");
+  long long days = daysSince2000 (pTarget->year,    pTarget->month,    pTarget->dayOfMonth)
+                 - daysSince2000 (pTarget->nowYear, pTarget->nowMonth, pTarget->nowDayOfMonth);
 
   double  nowTime = pTarget->nowTime;
   double riseTime = getOffsetRiseTime (pTarget);
   double  setTime = getOffsetSetTime  (pTarget);
-  long interval = (pTarget->upDown == UPDOWN_SUNRISE) ?  riseTime - nowTime : setTime - nowTime;
+  double interval = (pTarget->upDown == UPDOWN_SUNRISE) ?  riseTime - nowTime : setTime - nowTime;
 
-  // Add days
-  interval += days * 24;
+  // Add days, convert hours to seconds
+  return (interval + days * 24) * 3600.0;
+}
+
+/*
+** When poll()'s answer next changes, seconds since 1970 UTC, or -1 if not within TRANSITION_DAYS.
+** Each day, as poll() sees it, is night until the offset rise, day until the offset set and night
+** again, or all day or all night in polar day or night. So the change is at the start of the
+** first such span after now whose answer differs, which may be a midnight.
+*/
+/*
+** Above the twilight angle during one solar day, seconds since 1970: from the unclamped rise to
+** the set, with the offset, or the whole day for polar day. Empty (pFrom >= pTo) for polar night.
+*/
+static void solarDaySpan (targetStruct *pTarget, long long pDay, double *pTransit, double *pFrom, double *pTo)
+{
+  pTarget->daysSince2000 = pDay;
+  civilFromDaysSince2000 (pDay, &pTarget->year, &pTarget->month, &pTarget->dayOfMonth);
+  sunriset (pTarget);
+
+  double start = (pDay + DAYS_2000_JAN_0) * 86400.0;
+  *pTransit = start + pTarget->noonTime * 3600.0;
+  if (pTarget->dayType == DAYTYPE_POLAR_DAY)
+  { *pFrom = -HUGE_VAL;
+    *pTo   =  HUGE_VAL;
+  }
+  else if (pTarget->dayType == DAYTYPE_POLAR_NIGHT) *pFrom = *pTo = 0.0;
+  else
+  { *pFrom = start + (pTarget->riseTime + pTarget->hourOffset) * 3600.0;
+    *pTo   = start + (pTarget->setTime  - pTarget->hourOffset) * 3600.0;
+  }
+}
+
+/*
+** The sun's next rise or set after now, seconds since 1970, or -1 if none within TRANSITION_DAYS.
+** Each solar day, from 12 hours before its transit to 12 hours before the next, contributes its
+** span above the angle, as 'classify' does; spans that meet (polar day) are joined, so only real
+** rises and sets count, whichever side of midnight UT they fall.
+*/
+double next_transition (targetStruct *pTarget)
+{
+  long long today = daysSince2000 (pTarget->nowYear, pTarget->nowMonth, pTarget->nowDayOfMonth);
+  double    now   = (today + DAYS_2000_JAN_0) * 86400.0 + pTarget->nowTime * 3600.0;
+  targetStruct target = *pTarget;
+
+  double  transit, from, to, nextTransit, nextFrom, nextTo, windowEnd = 0.0;
+  double  spanFrom = 0.0, spanTo = 0.0;
+  boolean open = false;
+  solarDaySpan (&target, today - 1, &transit, &from, &to);
+  for (long long day = today - 1; day < today + TRANSITION_DAYS; day++)
+  { solarDaySpan (&target, day + 1, &nextTransit, &nextFrom, &nextTo);
+    windowEnd = nextTransit - 43200.0;
+    from = fmax (from, transit - 43200.0);
+    to   = fmin (to,   windowEnd);
+    if (from < to)
+    { if (open && from <= spanTo) spanTo = to;
+      else
+      { /* A span is over: the change is its start or end, whichever comes after now */
+        if (open && spanTo > now) return spanFrom > now ? spanFrom : spanTo;
+        spanFrom = from;
+        spanTo   = to;
+        open     = true;
+      }
+    }
+    transit = nextTransit;
+    from    = nextFrom;
+    to      = nextTo;
+  }
+
+  /* The last span may run on past the days searched */
+  if (open && spanFrom > now) return spanFrom;
+  if (open && spanTo > now && spanTo < windowEnd) return spanTo;
+  return -1;
+}
+
+int wait (targetStruct *pTarget)
+{
+  if (daysSince2000 (pTarget->year, pTarget->month, pTarget->dayOfMonth) < daysSince2000 (pTarget->nowYear, pTarget->nowMonth, pTarget->nowDayOfMonth))
+    printf ("Debug: Event already passed previous day.\n");
+
+  double interval = wait_seconds (pTarget);
 
   // Don't wait if event has passed
   if (interval < 0)
-  { interval = 0;
-    if (pTarget->debug == ONOFF_ON) printf ("Debug: Event already passed today.\n");
+  { if (pTarget->debug == ONOFF_ON) printf ("Debug: Event already passed today.\n");
     return EXIT_ERROR;
   }
 
   // In debug mode, we don't want to wait for sunrise or sunset. Wait a minute instead.
   if (pTarget->debug == ONOFF_ON)
   {
-    printf("Debug: Debug mode, \"wait\" reduced from %lu hours to 1 minute.\n", interval);
-    interval = (60 * 1000);
+    printf("Debug: Debug mode, \"wait\" reduced from %.0f seconds to 1 minute.\n", interval);
+    interval = 60;
   }
   else
   {
-    printf("Debug: Wait (seconds): %lu\n", interval);
-    // Convert hours to milliseconds
-    interval *= 60 * 60 * 1000;
+    printf("Debug: Wait (seconds): %.0f\n", interval);
   }
 
+  print_refine (pTarget);
+
   // This is it - wait until event occurs and then exit normally
-  //Sleep (interval); // Windows
-  //  sleep (interval/1000);    // Linux sleep accepts seconds
-  std::this_thread::sleep_for(std::chrono::milliseconds(interval)); // this should work on all platforms
+  clock_sleep (interval);
 
   return EXIT_OK;
 }
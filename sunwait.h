@@ -20,6 +20,21 @@ typedef enum
 , FUNCTION_LIST                // List the specified number of days times for sunrise and sunset of specified twiligh
 , FUNCTION_USAGE               // List the command line usage instructions
 , FUNCTION_VERSION             // List this programs version
+, FUNCTION_TERMINATOR          // Print the line on Earth where the sun is at the specified twilight angle
+, FUNCTION_TABLE               // List sunrise and sunset for every site in a site file, for the specified number of days
+, FUNCTION_STREAM              // Answer a stream of poll/list/next queries from standard input
+, FUNCTION_INDEX               // Build a day/night index for the target year, answer time queries from standard input
+, FUNCTION_AGGREGATE           // Total daylight and twilight hours per month and year, for every site
+, FUNCTION_BENCH               // Compare the throughput and agreement of the solar engines
+, FUNCTION_DAYLIT              // List the sites in daylight, or about to change, at times from standard input
+, FUNCTION_COMPILE             // Write the site file as a compiled catalog
+, FUNCTION_ARCHIVE             // Write every site's rise and set for the specified number of days to a compressed archive
+, FUNCTION_UNARCHIVE           // List rise and set from a compressed archive, as the table does
+, FUNCTION_TRACK               // List where the sun crosses the twilight angle along a time-stamped track
+, FUNCTION_SOLARTIME           // Convert times from standard input to local apparent solar time and hour angle
+, FUNCTION_INSOLATION          // Extraterrestrial and clear-sky irradiation per site and day, or hour
+, FUNCTION_CLASSIFY            // Tag time-sorted rows from standard input with their twilight phase
+, FUNCTION_CURVE               // Piecewise-linear brightness schedule from the sun's altitude, per site and day
 , FUNCTION_NOT_SET = NOT_SET 
 } Function;
 
@@ -30,11 +45,22 @@ typedef enum
 , UPDOWN_NOT_SET = NOT_SET
 } UpDown;
 
+// Which algorithm computes sunrise and sunset
+typedef enum
+{ ENGINE_FAST                  // Schlyter: one ephemeris per day, about a minute or two of error
+, ENGINE_NOAA                  // NOAA/Meeus: ephemeris at each event, iterated, seconds of error
+, ENGINE_NOT_SET = NOT_SET     // Sites only: use the target's engine
+} Engine;
+
 typedef enum
 { ONOFF_ON
 , ONOFF_OFF
 } OnOff;
 
+struct horizonStruct;
+struct cellCacheStruct;
+struct curveTransferStruct;
+
 typedef struct
 { 
   double latitude;            // Degrees N
@@ -51,7 +77,7 @@ typedef struct
   unsigned int year;       // Normal Calendar Year - eg 2013
   unsigned int month;      // Normal Month, January = 1 to December = 12
   unsigned int dayOfMonth; // 1 to 31
-  unsigned int daysSince2000;
+  long long daysSince2000; // Days since 2000 Jan 0.0, negative before 2000
   DayType  dayType;
   Function function;       // What is this program meant to do?
   OnOff    report;         // Is a report required
@@ -59,8 +85,48 @@ typedef struct
   OnOff    exitReport;     // Return text exit: "DAY", "NIGHT", "ERROR", "OK"
   UpDown   upDown;         // Look for sun rising, setting or either
   unsigned int list;       // How many days should sunrise/set be listed for
+  unsigned int points;     // How many longitude samples the terminator polyline should have
+  OnOff    binary;         // Binary rather than text (GeoJSON) output, where supported
+  const char *siteFile;    // File of named sites, for multi-site functions. NULL: just this target
+  unsigned int threads;    // Worker threads for multi-site functions, 0 = one per CPU
+  double   resolution;     // Unit: minutes, time resolution of the day/night index and simulated polls
+  const struct horizonStruct *horizon; // Local skyline for rise/set. NULL: mathematical horizon
+  OnOff    simulate;       // Replay wait/poll decisions on a virtual clock
+  double   simulateFrom;   // Unit: seconds since 1970 UTC, start of simulation
+  double   simulateTo;     // Unit: seconds since 1970 UTC, end of simulation
+  double   speed;          // Simulated seconds per real second, 0 = as fast as possible
+  Engine   engine;         // Algorithm used by sunriset()
+  OnOff    refine;         // Fast engine: re-evaluate the sun's position at rise and set
+  OnOff    refineSeeded;   // The refine fields below hold a converged day's corrections
+  long long refineDay;     // Days since 2000 of the converged day
+  double   refineAngle;    // Twilight angle, latitude and longitude of the converged day
+  double   refineLatitude;
+  double   refineLongitude;
+  double   riseCorrection; // Unit: hours, refined minus closed-form rise time, on the converged day
+  double   setCorrection;  // Unit: hours, refined minus closed-form set time, on the converged day
+  unsigned long refineEvents;     // Events refined, for the debug iteration count
+  unsigned long refineIterations; // sun_RA_dec() evaluations spent refining them
+  struct cellCacheStruct *cache;  // Interpolate nearby locations' results. NULL: compute every time
+  const char *compileFile; // Compiled catalog to write
+  const char *archiveFile; // Compressed schedule archive to write or read
+  const char *trackFile;   // Track of fixes for 'track'. NULL or "-": standard input
+  OnOff    hourly;         // 'insolation' per UT hour rather than per day
+  OnOff    transition;     // 'poll' also prints when its answer next changes
+  const char *outputFile;  // 'table' writes here rather than to standard output
+  const char *manifestFile;// With outputFile: per-site input hashes, so unchanged sites are copied
+  OnOff    direct;         // Bulk output files opened O_DIRECT
+  const struct curveTransferStruct *transfer; // 'curve' brightness from the sun's altitude
+  double   maxError;       // 'curve' largest brightness error of the fitted points
+  unsigned int within;     // Unit: minutes, 'daylit' lists sites changing within this. 0 = sites in daylight
 } targetStruct;
 
+/* Command line parsing, also used for queries read by "stream" */
+void    myToLower        (char *arg);
+boolean myIsNumber       (char *arg);
+boolean myIsSignedFloat  (char *arg);
+boolean isBearing        (targetStruct *pTarget, char *pArg);
+boolean isOffset         (targetStruct *pTarget, char *pArg);
+
 double getOffsetRiseTime (targetStruct *pTarget);
 double getOffsetSetTime  (targetStruct *pTarget);
 
@@ -69,8 +135,15 @@ double getOffsetSetTime  (targetStruct *pTarget);
 #define EXIT_DAY   2
 #define EXIT_NIGHT 3
 
+void setNowTime (targetStruct *pTarget, double pSeconds);
+
 int poll (targetStruct *pTarget);
 int wait (targetStruct *pTarget);
+double wait_seconds (targetStruct *pTarget);
+
+/* Days ahead next_transition() looks, enough for the longest polar day or night */
+#define TRANSITION_DAYS 370
+double next_transition (targetStruct *pTarget);
 
 #endif
 
@@ -0,0 +1,446 @@
+/*
+** table.cpp - sunrise/sunset tables for many sites over many days, computed in parallel
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "sites.h"
+#include "pool.h"
+#include "horizon.h"
+#include "table.h"
+#include "writer.h"
+#include "cellcache.h"
+
+typedef struct
+{
+  targetStruct            *target;
+  const siteListStruct    *sites;
+  unsigned int             days;
+  unsigned int             daysPerChunk;
+  unsigned int             chunksPerSite;
+  size_t                   firstChunk;   // Chunk number of buffers[0] in this pass
+  tableChunkFunction       function;
+  std::vector<std::string> buffers;
+} tableStruct;
+
+static void runChunk (void *pContext, size_t pTask)
+{
+  tableStruct *table = (tableStruct *) pContext;
+  size_t chunk = table->firstChunk + pTask;
+  const siteStruct *site = &table->sites->sites[chunk / table->chunksPerSite];
+  unsigned int firstDay  = (chunk % table->chunksPerSite) * table->daysPerChunk;
+  unsigned int days      = table->days - firstDay < table->daysPerChunk ? table->days - firstDay : table->daysPerChunk;
+
+  targetStruct target  = *table->target;
+  target.latitude      = site->latitude;
+  target.longitude     = site->longitude;
+  if (site->engine != ENGINE_NOT_SET) target.engine = site->engine;
+  target.daysSince2000 = table->target->daysSince2000 + firstDay;
+  civilFromDaysSince2000 (target.daysSince2000, &target.year, &target.month, &target.dayOfMonth);
+
+  std::string *buffer = &table->buffers[pTask];
+  buffer->clear ();
+  table->function (&target, site, days, buffer);
+}
+
+/* Output goes to pFile, or else to pWriter */
+static void runTable
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+, FILE                 *pFile
+, writerStruct         *pWriter
+)
+{
+  if (pDays == 0 || pSites->count == 0) return;
+
+  tableStruct table;
+  table.target        = pTarget;
+  table.sites         = pSites;
+  table.days          = pDays;
+  table.daysPerChunk  = (pDaysPerChunk == 0 || pDaysPerChunk > pDays) ? pDays : pDaysPerChunk;
+  table.chunksPerSite = (pDays + table.daysPerChunk - 1) / table.daysPerChunk;
+  table.function      = pFunction;
+
+  /* Chunks run in passes, so only a pass worth of output is ever buffered */
+  unsigned int threads = pool_threads (pTarget->threads);
+  size_t chunks = pSites->count * table.chunksPerSite;
+  size_t pass   = (size_t) threads * 256;
+  table.buffers.resize (chunks < pass ? chunks : pass);
+
+  for (table.firstChunk = 0; table.firstChunk < chunks; table.firstChunk += pass)
+  { size_t tasks = chunks - table.firstChunk < pass ? chunks - table.firstChunk : pass;
+    pool_run (threads, tasks, runChunk, &table);
+    for (size_t i=0; i < tasks; i++)
+      if (pFile) fwrite (table.buffers[i].data (), 1, table.buffers[i].size (), pFile);
+      else writer_write (pWriter, table.buffers[i].data (), table.buffers[i].size ());
+  }
+}
+
+void run_table
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+, FILE                 *pFile
+)
+{
+  runTable (pTarget, pSites, pDays, pDaysPerChunk, pFunction, pFile, NULL);
+}
+
+void run_table_writer
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+, writerStruct         *pWriter
+)
+{
+  runTable (pTarget, pSites, pDays, pDaysPerChunk, pFunction, NULL, pWriter);
+}
+
+boolean run_table_output
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+)
+{
+  writerStruct *writer = writer_open (NULL, pTarget->direct, pTarget->debug);
+  if (!writer) return false;
+  runTable (pTarget, pSites, pDays, pDaysPerChunk, pFunction, NULL, writer);
+  return writer_close (writer);
+}
+
+boolean load_target_sites (targetStruct *pTarget, siteListStruct *pSites)
+{
+  if (pTarget->siteFile) return load_sites (pTarget->siteFile, pSites);
+
+  memset (pSites, 0, sizeof (*pSites));
+  pSites->sites = (siteStruct *) malloc (sizeof (siteStruct));
+  if (!pSites->sites) return false;
+  pSites->sites[0].name       = "-";
+  pSites->sites[0].nameLength = 1;
+  pSites->sites[0].latitude   = pTarget->latitude;
+  pSites->sites[0].longitude  = pTarget->longitude;
+  pSites->sites[0].engine     = ENGINE_NOT_SET;
+  pSites->count = 1;
+  return true;
+}
+
+static void appendDigits (std::string *pOutput, unsigned int pNumber, int pDigits)
+{
+  char digits[10];
+  for (int i = pDigits - 1; i >= 0; i--) { digits[i] = '0' + pNumber % 10; pNumber /= 10; }
+  pOutput->append (digits, pDigits);
+}
+
+void append_site (std::string *pOutput, const siteStruct *pSite)
+{
+  pOutput->append (pSite->name, pSite->nameLength);
+}
+
+void append_date (std::string *pOutput, const targetStruct *pTarget)
+{
+  appendDigits (pOutput, pTarget->year, 4);
+  pOutput->push_back ('-');
+  appendDigits (pOutput, pTarget->month, 2);
+  pOutput->push_back ('-');
+  appendDigits (pOutput, pTarget->dayOfMonth, 2);
+}
+
+/* As print_situation(), HH:MM, but without the sign for negative hours */
+void append_time (std::string *pOutput, double pHours)
+{
+  appendDigits (pOutput, (unsigned int) abs (hours (pHours)), 2);
+  pOutput->push_back (':');
+  appendDigits (pOutput, (unsigned int) minutes (pHours), 2);
+}
+
+static void tableChunk (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput)
+{
+  for (unsigned int day=0; day < pDays; day++)
+  {
+    sunriset (pTarget);
+    append_site (pOutput, pSite);
+    pOutput->push_back (',');
+    append_date (pOutput, pTarget);
+    if (pTarget->dayType == DAYTYPE_NORMAL)
+    { pOutput->push_back (',');
+      append_time (pOutput, getOffsetRiseTime (pTarget));
+      pOutput->push_back (',');
+      append_time (pOutput, getOffsetSetTime (pTarget));
+      pOutput->append (",normal\n");
+    }
+    else if (pTarget->dayType == DAYTYPE_POLAR_DAY)
+      pOutput->append (",--:--,--:--,polar-day\n");
+    else
+      pOutput->append (",--:--,--:--,polar-night\n");
+
+    pTarget->daysSince2000++;
+    civilFromDaysSince2000 (pTarget->daysSince2000, &pTarget->year, &pTarget->month, &pTarget->dayOfMonth);
+  }
+}
+
+/*
+** >>>>> Incremental tables <<<<<
+*/
+
+static uint64_t hashBytes (const void *pData, size_t pLength, uint64_t pHash = 14695981039346656037ull)
+{
+  const unsigned char *data = (const unsigned char *) pData;
+  for (size_t i=0; i < pLength; i++) pHash = (pHash ^ data[i]) * 1099511628211ull;
+  return pHash;
+}
+
+/* Whole file, mapped read-only. An empty file maps to no data */
+static boolean mapFile (const char *pFileName, const char **pData, size_t *pSize)
+{
+  *pData = NULL;
+  *pSize = 0;
+  int fd = open (pFileName, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat status;
+  boolean ok = fstat (fd, &status) == 0;
+  if (ok && status.st_size > 0)
+  { void *data = mmap (NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) ok = false;
+    else { *pData = (const char *) data; *pSize = status.st_size; }
+  }
+  close (fd);
+  return ok;
+}
+
+/* Hash of everything other than the site itself that a site's rows depend on */
+static uint64_t inputsHash (const targetStruct *pTarget, unsigned int pDays)
+{
+  struct
+  { uint32_t version;
+    uint32_t days;
+    int64_t  firstDay;
+    double   twilightAngle;
+    double   hourOffset;
+    uint64_t horizonHash;
+    int32_t  engine;
+    int32_t  refine;
+    double   cellDegrees;    // 0 without a cell cache
+    double   cellError;
+  } inputs;
+  memset (&inputs, 0, sizeof (inputs));
+  inputs.version       = TABLE_MANIFEST_VERSION;
+  inputs.days          = pDays;
+  inputs.firstDay      = pTarget->daysSince2000;
+  inputs.twilightAngle = pTarget->twilightAngle;
+  inputs.hourOffset    = pTarget->hourOffset;
+  inputs.horizonHash   = pTarget->horizon ? hashBytes (pTarget->horizon->elevation, sizeof (pTarget->horizon->elevation)) : 0;
+  inputs.engine        = pTarget->engine;
+  inputs.refine        = pTarget->refine;
+  if (pTarget->cache) cellcache_settings (pTarget->cache, &inputs.cellDegrees, &inputs.cellError);
+  return hashBytes (&inputs, sizeof (inputs));
+}
+
+static uint64_t siteHash (uint64_t pInputs, const siteStruct *pSite)
+{
+  uint64_t hash = hashBytes (pSite->name, pSite->nameLength, pInputs);
+  hash = hashBytes (&pSite->latitude,  sizeof (pSite->latitude),  hash);
+  hash = hashBytes (&pSite->longitude, sizeof (pSite->longitude), hash);
+  return hashBytes (&pSite->engine, sizeof (pSite->engine), hash);
+}
+
+/* The previous run's rows for a site, if its inputs are unchanged and the rows look like its own */
+static const tableManifestRecord *findRows
+( const tableManifestRecord *pRecords
+, size_t                     pCount
+, uint64_t                   pNameHash
+, uint64_t                   pInputHash
+, const siteStruct          *pSite
+, const char                *pOutput
+, size_t                     pOutputSize
+)
+{
+  const tableManifestRecord *record = std::lower_bound (pRecords, pRecords + pCount, pNameHash,
+    [] (const tableManifestRecord &a, uint64_t b) { return a.nameHash < b; });
+  for (; record < pRecords + pCount && record->nameHash == pNameHash; record++)
+    if ( record->inputHash == pInputHash
+      && record->offset <= pOutputSize && record->length <= pOutputSize - record->offset
+      && record->length > pSite->nameLength
+      && !memcmp (pOutput + record->offset, pSite->name, pSite->nameLength)
+      && pOutput[record->offset + pSite->nameLength] == ','
+      && pOutput[record->offset + record->length - 1] == '\n')
+      return record;
+  return NULL;
+}
+
+/* Row lengths of the sites being computed, filled in by the chunks */
+static const siteListStruct *sChanged;
+static std::vector<uint64_t> sLength;
+
+static void changedChunk (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput)
+{
+  tableChunk (pTarget, pSite, pDays, pOutput);
+  sLength[pSite - sChanged->sites] = pOutput->size ();
+}
+
+static boolean replaceFile (const char *pTemporary, const char *pFileName, FILE *pFile)
+{
+  boolean ok = !ferror (pFile);
+  if (fclose (pFile) != 0) ok = false;
+  if (ok && rename (pTemporary, pFileName) != 0) ok = false;
+  if (!ok)
+  { printf ("Error: Unable to write %s\n", pFileName);
+    remove (pTemporary);
+  }
+  return ok;
+}
+
+static boolean writeTable (targetStruct *pTarget, const siteListStruct *pSites, unsigned int pDays)
+{
+  boolean ok = false;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+  /* The previous output and its manifest, if they belong together */
+  const char *previous = NULL, *manifest = NULL;
+  size_t previousSize = 0, manifestSize = 0;
+  const tableManifestRecord *records = NULL;
+  size_t recordCount = 0;
+  if (pTarget->manifestFile && mapFile (pTarget->manifestFile, &manifest, &manifestSize) && manifestSize >= sizeof (tableManifestHeader))
+  { const tableManifestHeader *header = (const tableManifestHeader *) manifest;
+    if ( !memcmp (header->magic, TABLE_MANIFEST_MAGIC, 4) && header->version == TABLE_MANIFEST_VERSION
+      && header->count == (manifestSize - sizeof (*header)) / sizeof (tableManifestRecord)
+      && mapFile (pTarget->outputFile, &previous, &previousSize) && previousSize == header->outputSize)
+    { records     = (const tableManifestRecord *) (manifest + sizeof (*header));
+      recordCount = header->count;
+    }
+  }
+
+  /* Which sites can be copied, and which must be computed */
+  uint64_t inputs = inputsHash (pTarget, pDays);
+  std::vector<tableManifestRecord> entries (pSites->count);
+  std::vector<const tableManifestRecord *> reuse (pSites->count);
+  siteListStruct changed;
+  memset (&changed, 0, sizeof (changed));
+  changed.sites = (siteStruct *) malloc ((pSites->count ? pSites->count : 1) * sizeof (siteStruct));
+  for (size_t i=0; i < pSites->count; i++)
+  { const siteStruct *site = &pSites->sites[i];
+    entries[i].nameHash  = hashBytes (site->name, site->nameLength);
+    entries[i].inputHash = siteHash (inputs, site);
+    reuse[i] = findRows (records, recordCount, entries[i].nameHash, entries[i].inputHash, site, previous, previousSize);
+    if (!reuse[i]) changed.sites[changed.count++] = *site;
+  }
+
+  /* Compute the changed sites into a scratch file, in site order */
+  FILE *fresh = tmpfile ();
+  if (!fresh) printf ("Error: Unable to create a temporary file\n");
+  sChanged = &changed;
+  sLength.assign (changed.count, 0);
+  if (fresh) run_table (pTarget, &changed, pDays, 0, changedChunk, fresh);
+  if (fresh && (fflush (fresh) != 0 || ferror (fresh)))
+  { printf ("Error: Unable to write a temporary file\n");
+    fclose (fresh);
+    fresh = NULL;
+  }
+
+  char temporary[4096];
+  snprintf (temporary, sizeof (temporary), "%s.tmp", pTarget->outputFile);
+  writerStruct *output = fresh ? writer_open (temporary, pTarget->direct, pTarget->debug) : NULL;
+  if (output)
+  { /* Splice the copied and computed rows back into site order */
+    rewind (fresh);
+    std::vector<char> buffer (1 << 16);
+    uint64_t offset = 0;
+    size_t computed = 0;
+    for (size_t i=0; i < pSites->count; i++)
+    { uint64_t length;
+      if (reuse[i])
+      { length = reuse[i]->length;
+        writer_write (output, previous + reuse[i]->offset, length);
+      }
+      else
+      { length = sLength[computed++];
+        for (uint64_t left = length; left > 0; )
+        { size_t part = fread (buffer.data (), 1, left < buffer.size () ? left : buffer.size (), fresh);
+          if (part == 0) break;
+          writer_write (output, buffer.data (), part);
+          left -= part;
+        }
+      }
+      entries[i].offset = offset;
+      entries[i].length = length;
+      offset += length;
+    }
+
+    /* Old mappings go before their files are replaced */
+    if (previous) munmap ((void *) previous, previousSize);
+    if (manifest) munmap ((void *) manifest, manifestSize);
+    previous = manifest = NULL;
+
+    boolean written = writer_close (output);
+    if (written && rename (temporary, pTarget->outputFile) != 0)
+    { printf ("Error: Unable to write %s\n", pTarget->outputFile);
+      written = false;
+    }
+    if (!written) remove (temporary);
+    ok = written;
+    if (written && pTarget->manifestFile)
+    { std::sort (entries.begin (), entries.end (), [] (const tableManifestRecord &a, const tableManifestRecord &b) { return a.nameHash < b.nameHash; });
+      tableManifestHeader header;
+      memset (&header, 0, sizeof (header));
+      memcpy (header.magic, TABLE_MANIFEST_MAGIC, 4);
+      header.version    = TABLE_MANIFEST_VERSION;
+      header.count      = entries.size ();
+      header.outputSize = offset;
+      snprintf (temporary, sizeof (temporary), "%s.tmp", pTarget->manifestFile);
+      FILE *file = fopen (temporary, "wb");
+      if (!file)
+      { printf ("Error: Unable to create %s\n", temporary);
+        ok = false;
+      }
+      else
+      { fwrite (&header, sizeof (header), 1, file);
+        if (!entries.empty ()) fwrite (entries.data (), sizeof (tableManifestRecord), entries.size (), file);
+        ok = replaceFile (temporary, pTarget->manifestFile, file);
+      }
+    }
+  }
+
+  if (pTarget->debug == ONOFF_ON)
+  { std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+    printf ( "Debug: Table - %lu sites, %lu copied, %lu computed, %.3f seconds\n"
+           , (unsigned long) pSites->count, (unsigned long) (pSites->count - changed.count), (unsigned long) changed.count, elapsed.count ());
+  }
+
+  if (previous) munmap ((void *) previous, previousSize);
+  if (manifest) munmap ((void *) manifest, manifestSize);
+  if (fresh) fclose (fresh);
+  sLength.clear ();
+  free (changed.sites);
+  return ok;
+}
+
+boolean print_table (targetStruct *pTarget)
+{
+  siteListStruct sites;
+  if (!load_target_sites (pTarget, &sites)) return false;
+
+  boolean ok;
+  if (pTarget->outputFile) ok = writeTable (pTarget, &sites, pTarget->list);
+  else ok = run_table_output (pTarget, &sites, pTarget->list, 32, tableChunk);
+
+  free_sites (&sites);
+  return ok;
+}
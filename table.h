@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include "sunwait.h"
+#include "sites.h"
+#include "writer.h"
+
+#ifndef TABLE_H
+  #define TABLE_H
+
+/*
+** Called for one chunk of a table: pTarget is a private copy of the target, with the site's
+** coordinates and the chunk's first day already set. Append pDays days of output to pOutput.
+*/
+typedef void (*tableChunkFunction) (targetStruct *pTarget, const siteStruct *pSite, unsigned int pDays, std::string *pOutput);
+
+/*
+** Split (sites x pDays days) into chunks of pDaysPerChunk days (0 = all days in one chunk), run
+** them on the work-stealing pool and write their output to pFile in site, then day, order.
+*/
+void run_table
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+, FILE                 *pFile
+);
+
+/* As run_table(), into a bulk output writer */
+void run_table_writer
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+, writerStruct         *pWriter
+);
+
+/* As run_table(), to standard output through a writer of its own. False if writing failed */
+boolean run_table_output
+( targetStruct         *pTarget
+, const siteListStruct *pSites
+, unsigned int          pDays
+, unsigned int          pDaysPerChunk
+, tableChunkFunction    pFunction
+);
+
+/* Site file from the target, or else the target's own coordinates as a single site */
+boolean load_target_sites (targetStruct *pTarget, siteListStruct *pSites);
+
+/* Fast formatting helpers for chunk functions */
+void append_site (std::string *pOutput, const siteStruct *pSite);
+void append_date (std::string *pOutput, const targetStruct *pTarget);
+void append_time (std::string *pOutput, double pHours);
+
+/*
+** Incremental tables: with 'output FILE manifest FILE', the manifest records, per site, a hash of
+** everything its rows depend on and where its rows are in the output. The next run only computes
+** sites whose hash changed, or that are new, and copies the rest from the previous output.
+** Bump TABLE_MANIFEST_VERSION whenever the computation or row format changes.
+*/
+#define TABLE_MANIFEST_MAGIC   "SWM1"
+#define TABLE_MANIFEST_VERSION 1
+
+typedef struct
+{
+  char     magic[4];
+  uint32_t version;
+  uint64_t count;
+  uint64_t outputSize;     // Of the output written with this manifest
+} tableManifestHeader;
+
+typedef struct
+{
+  uint64_t nameHash;       // Records are sorted by this
+  uint64_t inputHash;
+  uint64_t offset;         // Of the site's rows in the output
+  uint64_t length;
+} tableManifestRecord;
+
+/* To standard output, or to 'output FILE'. False if it could not be written */
+boolean print_table (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,246 @@
+/*
+** terminator.cpp - computes the day/night terminator (or any twilight line) as a polyline
+**
+** The sun is at altitude h wherever the angular distance to the subsolar point is 90-h degrees.
+** For each meridian, relative to the subsolar point by hour angle H, the crossing latitudes solve:
+**
+**   sin(h) = sin(lat) * sin(dec) + cos(lat) * cos(dec) * cos(H)
+**
+** Written as R*sin(lat+psi) = sin(h), with R = sqrt(sin(dec)^2 + (cos(dec)*cos(H))^2), there are
+** at most two crossings. The cos(H) values are fixed by the sample spacing, so they are computed
+** once in terminator_init() and each frame only costs a sqrt, asin and atan2 per sample.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "terminator.h"
+
+boolean terminator_init (terminatorStruct *pTerminator, unsigned int pPoints)
+{
+  if (pPoints < 3) pPoints = 3;
+
+  pTerminator->points       = pPoints;
+  pTerminator->cosHourAngle = (double *) malloc (pPoints * sizeof (double));
+  pTerminator->latitude1    = (double *) malloc (pPoints * sizeof (double));
+  pTerminator->latitude2    = (double *) malloc (pPoints * sizeof (double));
+  pTerminator->loop         = false;
+
+  if (!pTerminator->cosHourAngle || !pTerminator->latitude1 || !pTerminator->latitude2)
+  { terminator_free (pTerminator);
+    return false;
+  }
+
+  for (unsigned int i=0; i < pPoints; i++)
+    pTerminator->cosHourAngle[i] = cosd (-180.0 + 360.0 * i / (pPoints - 1));
+
+  return true;
+}
+
+void terminator_free (terminatorStruct *pTerminator)
+{
+  free (pTerminator->cosHourAngle);
+  free (pTerminator->latitude1);
+  free (pTerminator->latitude2);
+  pTerminator->cosHourAngle = NULL;
+  pTerminator->latitude1    = NULL;
+  pTerminator->latitude2    = NULL;
+  pTerminator->points       = 0;
+}
+
+/* Reduce radians to -PI to +PI */
+static double revPi (double x)
+{
+  while (x >   PI) x -= 2.0 * PI;
+  while (x <= -PI) x += 2.0 * PI;
+  return x;
+}
+
+/*
+** Solve one frame.
+**   pDays          = Days since 2000 Jan 0.0, including the fraction of the day (UT)
+**   pTwilightAngle = Altitude of the sun along the curve, as targetStruct.twilightAngle
+*/
+void terminator_frame (terminatorStruct *pTerminator, double pDays, double pTwilightAngle)
+{
+  double sra, sdec, sr;
+  sun_RA_dec (pDays, &sra, &sdec, &sr);
+
+  /* Greenwich sidereal time at this instant; GMST0() is generalised to take the day fraction */
+  double ut   = (pDays - floor (pDays)) * 24.0;
+  double gmst = GMST0 (pDays) + ut * 15.0;
+
+  pTerminator->subsolarLatitude  = sdec;
+  pTerminator->subsolarLongitude = rev180 (sra - gmst);
+
+  /* Same upper limb correction as sunriset() */
+  double altit = pTwilightAngle;
+  if (pTwilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altit -= 0.2666 / sr;
+
+  /*
+  ** The circle, 90-h degrees from the subsolar point, holds the north pole when dec > h and the
+  ** south pole when dec < -h. It goes round a pole, crossing every meridian once, when it holds
+  ** exactly one of them; otherwise, |dec| < |h|, it is a loop: around the subsolar point above the
+  ** horizon, around the antisolar point (holding both poles) below it.
+  */
+  pTerminator->loop = fabs (sdec) < fabs (altit);
+
+  double sinDec = sind (sdec);
+  double cosDec = cosd (sdec);
+  double sinAlt = sind (altit);
+
+  for (unsigned int i=0; i < pTerminator->points; i++)
+  {
+    double b = cosDec * pTerminator->cosHourAngle[i];
+    double r = sqrt (sinDec * sinDec + b * b);
+
+    pTerminator->latitude1[i] = NAN;
+    pTerminator->latitude2[i] = NAN;
+
+    if (r < 1e-12 || fabs (sinAlt) > r) continue;
+
+    double psi  = atan2 (b, sinDec);
+    double base = asin (sinAlt / r);
+    double lat1 = revPi (base - psi);
+    double lat2 = revPi (PI - base - psi);
+    boolean valid1 = fabs (lat1) <= PI / 2.0;
+    boolean valid2 = fabs (lat2) <= PI / 2.0;
+
+    if (valid1 && valid2)
+    { pTerminator->latitude1[i] = RADIAN_TO_DEGREE * fmax (lat1, lat2);
+      pTerminator->latitude2[i] = RADIAN_TO_DEGREE * fmin (lat1, lat2);
+    }
+    else if (valid1) pTerminator->latitude1[i] = RADIAN_TO_DEGREE * lat1;
+    else if (valid2) pTerminator->latitude1[i] = RADIAN_TO_DEGREE * lat2;
+  }
+
+  /* A curve around a pole has a single crossing per meridian, keep it on one branch */
+  if (!pTerminator->loop)
+    for (unsigned int i=0; i < pTerminator->points; i++)
+      if (isnan (pTerminator->latitude1[i])) pTerminator->latitude1[i] = pTerminator->latitude2[i];
+}
+
+/* Longitude of sample i, in degrees E */
+static double sampleLongitude (terminatorStruct *pTerminator, unsigned int i)
+{
+  return rev180 (pTerminator->subsolarLongitude - 180.0 + 360.0 * i / (pTerminator->points - 1));
+}
+
+/*
+** Collect the polyline, in drawing order, into pLongitude/pLatitude (each 2*points long).
+** Curves around a pole run west to east from the antimeridian, loops are closed rings.
+*/
+static unsigned int terminator_polyline (terminatorStruct *pTerminator, double *pLongitude, double *pLatitude)
+{
+  unsigned int n = 0;
+  unsigned int unique = pTerminator->points - 1; /* First and last samples are the same meridian */
+
+  if (!pTerminator->loop)
+  { /* Start where the longitude wraps, so longitudes increase */
+    unsigned int start = 0;
+    for (unsigned int i=1; i < unique; i++)
+      if (sampleLongitude (pTerminator, i) < sampleLongitude (pTerminator, start)) start = i;
+
+    for (unsigned int k=0; k < unique; k++)
+    { unsigned int i = (start + k) % unique;
+      if (isnan (pTerminator->latitude1[i])) continue;
+      pLongitude[n] = sampleLongitude (pTerminator, i);
+      pLatitude[n]  = pTerminator->latitude1[i];
+      n++;
+    }
+    return n;
+  }
+
+  /*
+  ** The meridians a loop crosses are one run of samples, which below the horizon is around the
+  ** antisolar point and so straddles the seam between the last sample and the first. Start at the
+  ** run's first sample, go along its northern crossings and back along its southern ones.
+  */
+  unsigned int start = 0;
+  for (unsigned int i=0; i < unique; i++)
+    if (!isnan (pTerminator->latitude1[i]) && isnan (pTerminator->latitude1[(i + unique - 1) % unique]))
+    { start = i;
+      break;
+    }
+
+  unsigned int run = 0;
+  while (run < unique && !isnan (pTerminator->latitude1[(start + run) % unique])) run++;
+
+  for (unsigned int k=0; k < run; k++)
+  { unsigned int i = (start + k) % unique;
+    pLongitude[n] = sampleLongitude (pTerminator, i);
+    pLatitude[n]  = pTerminator->latitude1[i];
+    n++;
+  }
+
+  for (unsigned int k=run; k-- > 0; )
+  { unsigned int i = (start + k) % unique;
+    if (isnan (pTerminator->latitude2[i])) continue;
+    pLongitude[n] = sampleLongitude (pTerminator, i);
+    pLatitude[n]  = pTerminator->latitude2[i];
+    n++;
+  }
+
+  /* Close the ring */
+  if (n > 0)
+  { pLongitude[n] = pLongitude[0];
+    pLatitude[n]  = pLatitude[0];
+    n++;
+  }
+  return n;
+}
+
+void print_terminator (targetStruct *pTarget)
+{
+  terminatorStruct terminator;
+  if (!terminator_init (&terminator, pTarget->points))
+  { printf ("Error: Unable to allocate terminator of %u points.\n", pTarget->points);
+    return;
+  }
+
+  double days = pTarget->daysSince2000 + pTarget->nowTime / 24.0;
+  terminator_frame (&terminator, days, pTarget->twilightAngle);
+
+  if (pTarget->debug == ONOFF_ON)
+  { const int frames = 1000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i=0; i < frames; i++) terminator_frame (&terminator, days + i / 86400.0, pTarget->twilightAngle);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf ("Debug: Terminator - %u points, %.0f frames per second.\n", terminator.points, frames / elapsed.count());
+    terminator_frame (&terminator, days, pTarget->twilightAngle);
+  }
+
+  double *longitude = (double *) malloc ((2 * terminator.points + 1) * sizeof (double));
+  double *latitude  = (double *) malloc ((2 * terminator.points + 1) * sizeof (double));
+  unsigned int n = terminator_polyline (&terminator, longitude, latitude);
+
+  if (pTarget->binary == ONOFF_ON)
+  { /* Native-endian: uint32 point count, then float32 longitude/latitude pairs */
+    uint32_t count = n;
+    fwrite (&count, sizeof (count), 1, stdout);
+    for (unsigned int i=0; i < n; i++)
+    { float pair[2] = { (float) longitude[i], (float) latitude[i] };
+      fwrite (pair, sizeof (pair), 1, stdout);
+    }
+  }
+  else
+  { printf ("{\"type\":\"Feature\",\"properties\":{");
+    printf ("\"date\":\"%4.4u-%2.2u-%2.2uT%2.2d:%2.2d:%2.2dZ\","
+           , pTarget->year, pTarget->month, pTarget->dayOfMonth
+           , hours (pTarget->nowTime), minutes (pTarget->nowTime), seconds (pTarget->nowTime));
+    printf ("\"twilightAngle\":%.4f,", pTarget->twilightAngle);
+    printf ("\"subsolar\":[%.6f,%.6f]},", terminator.subsolarLongitude, terminator.subsolarLatitude);
+    printf ("\"geometry\":{\"type\":\"LineString\",\"coordinates\":[");
+    for (unsigned int i=0; i < n; i++)
+      printf ("%s[%.6f,%.6f]", i ? "," : "", longitude[i], latitude[i]);
+    printf ("]}}\n");
+  }
+
+  free (longitude);
+  free (latitude);
+  terminator_free (&terminator);
+}
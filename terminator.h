@@ -0,0 +1,27 @@
+#include "sunwait.h"
+
+#ifndef TERMINATOR_H
+  #define TERMINATOR_H
+
+/*
+** The terminator for a given twilight angle is the small circle on Earth where the sun sits exactly
+** at that altitude. It is solved per longitude sample, relative to the subsolar point.
+*/
+typedef struct
+{
+  unsigned int points;     // Hour-angle samples from -180 to +180 degrees (inclusive)
+  double *cosHourAngle;    // Fixed per sample, so a frame needs no trigonometry of its own per longitude
+  double *latitude1;       // Northern crossing of the meridian, NAN if the meridian does not cross
+  double *latitude2;       // Southern crossing, only set where the terminator is a closed loop
+  double subsolarLatitude;  // Degrees N
+  double subsolarLongitude; // Degrees E, -180 to +180
+  boolean loop;            // True when the curve encircles neither pole
+} terminatorStruct;
+
+boolean terminator_init  (terminatorStruct *pTerminator, unsigned int pPoints);
+void    terminator_free  (terminatorStruct *pTerminator);
+void    terminator_frame (terminatorStruct *pTerminator, double pDays, double pTwilightAngle);
+
+void print_terminator (targetStruct *pTarget);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+** track.cpp - rise and set along a moving observer's track
+**
+** Between fixes the observer moves in a straight line (in latitude and longitude) at constant
+** speed. The sun's altitude along the track is
+**
+**   sin(alt) = sin(lat)*sin(dec) + cos(lat)*cos(dec)*cos(lon - subsolar)
+**
+** where dec and the subsolar longitude move smoothly: they are evaluated once per anchor and
+** advanced linearly from it, so each point costs a few sines and no ephemeris. A crossing is a
+** change of sign of sin(alt) - sin(h) between two points, then solved by regula falsi.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "sunwait.h"
+#include "sunriset.h"
+#include "days.h"
+#include "track.h"
+
+typedef struct
+{
+  double time;        /* Unit: seconds since 1970 UTC, of the anchor */
+  double dec;         /* Degrees, at the anchor */
+  double decRate;     /* Degrees per second */
+  double subsolar;    /* Longitude, degrees E, at the anchor */
+  double subsolarRate;/* Degrees per second, about -1/240 */
+} trackSunStruct;
+
+typedef struct
+{
+  double time;
+  double latitude;
+  double longitude;
+  double value;       /* sin(alt) - sin(h) */
+} trackPointStruct;
+
+/* Declination and subsolar longitude at an instant, as daylit's sunAt() */
+static void sunAt (double pTime, double *pDec, double *pSubsolar)
+{
+  double days  = floor (pTime / 86400.0);
+  double hours = (pTime - days * 86400.0) / 3600.0;
+  ephemerisStruct ephemeris;
+  sun_ephemeris (days - DAYS_2000_JAN_0 + hours / 24.0, &ephemeris);
+  *pDec      = ephemeris.sdec;
+  *pSubsolar = revolution (ephemeris.sra - ephemeris.gmst0 - 15.0 * hours);
+}
+
+static void anchor (trackSunStruct *pSun, double pTime)
+{
+  double dec, subsolar;
+  pSun->time = floor (pTime / TRACK_ANCHOR_SECONDS) * TRACK_ANCHOR_SECONDS;
+  sunAt (pSun->time, &pSun->dec, &pSun->subsolar);
+  sunAt (pSun->time + TRACK_ANCHOR_SECONDS, &dec, &subsolar);
+  pSun->decRate      = (dec - pSun->dec) / TRACK_ANCHOR_SECONDS;
+  pSun->subsolarRate = rev180 (subsolar - pSun->subsolar) / TRACK_ANCHOR_SECONDS;
+}
+
+static double evaluate (trackSunStruct *pSun, double pSinAltitude, double pTime, double pLatitude, double pLongitude)
+{
+  if (pTime < pSun->time || pTime >= pSun->time + TRACK_ANCHOR_SECONDS) anchor (pSun, pTime);
+  double elapsed  = pTime - pSun->time;
+  double dec      = pSun->dec + pSun->decRate * elapsed;
+  double subsolar = pSun->subsolar + pSun->subsolarRate * elapsed;
+  return sind (pLatitude) * sind (dec) + cosd (pLatitude) * cosd (dec) * cosd (pLongitude - subsolar) - pSinAltitude;
+}
+
+/* The point a fraction of the way from pFrom to pTo, longitude the short way round */
+static void interpolate (const trackPointStruct *pFrom, const trackPointStruct *pTo, double pFraction, trackPointStruct *pPoint)
+{
+  pPoint->time      = pFrom->time + (pTo->time - pFrom->time) * pFraction;
+  pPoint->latitude  = pFrom->latitude + (pTo->latitude - pFrom->latitude) * pFraction;
+  pPoint->longitude = pFrom->longitude + rev180 (pTo->longitude - pFrom->longitude) * pFraction;
+}
+
+/* Crossing between two points of opposite sign, to a tenth of a second */
+static void solve (trackSunStruct *pSun, double pSinAltitude, const trackPointStruct *pFrom, const trackPointStruct *pTo, trackPointStruct *pCrossing)
+{
+  double lo = 0.0, hi = 1.0, fLo = pFrom->value, fHi = pTo->value;
+  int side = 0;
+  *pCrossing = *pFrom;
+  for (int i=0; i < 30; i++)
+  { double fraction = (lo * fHi - hi * fLo) / (fHi - fLo);
+    interpolate (pFrom, pTo, fraction, pCrossing);
+    double f = evaluate (pSun, pSinAltitude, pCrossing->time, pCrossing->latitude, pCrossing->longitude);
+    if ((hi - lo) * (pTo->time - pFrom->time) < 0.1 || f == 0.0) break;
+    /* Illinois: halve the stale end, so one-sided convergence doesn't stall */
+    if ((f > 0.0) == (fHi > 0.0)) { hi = fraction; fHi = f; if (side == -1) fLo /= 2.0; side = -1; }
+    else                          { lo = fraction; fLo = f; if (side ==  1) fHi /= 2.0; side =  1; }
+  }
+}
+
+static void appendCrossing (std::string *pOutput, const trackPointStruct *pCrossing, boolean pRise)
+{
+  char line[128];
+  long long days = (long long) floor (pCrossing->time / 86400.0);
+  formatIsoTime (line, sizeof (line), days, (pCrossing->time - days * 86400.0) / 3600.0);
+  size_t length = strlen (line);
+  snprintf (line + length, sizeof (line) - length, ",%s,%.5f,%.5f\n", pRise ? "rise" : "set", pCrossing->latitude, rev180 (pCrossing->longitude));
+  pOutput->append (line);
+}
+
+/* "time lat lon", separated by spaces, tabs or commas */
+static boolean parseFix (char *pLine, trackPointStruct *pFix)
+{
+  char *save = NULL, *field[3];
+  for (int i=0; i < 3; i++) if (!(field[i] = strtok_r (i ? NULL : pLine, " \t,\r\n", &save))) return false;
+
+  long long days;
+  double    hours;
+  char     *end;
+  if (!parseIsoTime (field[0], &days, &hours)) return false;
+  pFix->time      = days * 86400.0 + hours * 3600.0;
+  pFix->latitude  = strtod (field[1], &end); if (*end || pFix->latitude < -90.0 || pFix->latitude > 90.0) return false;
+  pFix->longitude = strtod (field[2], &end); if (*end) return false;
+  return true;
+}
+
+boolean run_track (targetStruct *pTarget)
+{
+  FILE *file = stdin;
+  if (pTarget->trackFile && strcmp (pTarget->trackFile, "-") && !(file = fopen (pTarget->trackFile, "r")))
+  { printf ("Error: Unable to open track: %s\n", pTarget->trackFile);
+    return false;
+  }
+
+  /* Sunrise/set altitude, as sunriset() uses for the twilight angle */
+  double altitude = pTarget->twilightAngle;
+  if (pTarget->twilightAngle == TWILIGHT_ANGLE_DAYLIGHT) altitude -= 0.2666;
+  double sinAltitude = sind (altitude);
+
+  trackSunStruct sun;
+  sun.time = -INFINITY;
+
+  char  *line = NULL;
+  size_t size = 0;
+  unsigned long lineNumber = 0, fixes = 0, crossings = 0;
+  boolean started = false;
+  trackPointStruct previous, fix, point, crossing;
+  std::string output;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  while (getline (&line, &size, file) != -1)
+  {
+    lineNumber++;
+    if (line[0] == '#' || line[strspn (line, " \t\r\n")] == '\0') continue;
+    if (!parseFix (line, &fix))
+    { printf ("ERROR Line %lu: expected \"YYYY-MM-DDTHH:MM[:SS] latitude longitude\"\n", lineNumber);
+      continue;
+    }
+    if (started && fix.time < previous.time)
+    { printf ("ERROR Line %lu: fix is earlier than the one before\n", lineNumber);
+      continue;
+    }
+    fixes++;
+    fix.value = evaluate (&sun, sinAltitude, fix.time, fix.latitude, fix.longitude);
+    if (!started) { previous = fix; started = true; continue; }
+
+    /* Long gaps in steps, each checked for a crossing */
+    int steps = (int) ceil ((fix.time - previous.time) / TRACK_STEP_SECONDS);
+    trackPointStruct from = previous;
+    for (int step=1; step <= steps; step++)
+    { if (step == steps) point = fix;
+      else
+      { interpolate (&previous, &fix, (double) step / steps, &point);
+        point.value = evaluate (&sun, sinAltitude, point.time, point.latitude, point.longitude);
+      }
+      if ((from.value > 0.0) != (point.value > 0.0))
+      { solve (&sun, sinAltitude, &from, &point, &crossing);
+        appendCrossing (&output, &crossing, point.value > 0.0);
+        crossings++;
+      }
+      from = point;
+    }
+    previous = fix;
+
+    /* Crossings are rare, so pass each one on at once */
+    if (!output.empty ())
+    { fwrite (output.data (), 1, output.size (), stdout);
+      fflush (stdout);
+      output.clear ();
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  if (pTarget->debug == ONOFF_ON)
+    printf ( "Debug: Track - %lu fixes, %lu crossings, %.3f seconds, %.0f fixes per second\n"
+           , fixes, crossings, elapsed.count (), fixes / fmax (elapsed.count (), 1e-9));
+  boolean ok = !ferror (file);
+  if (!ok) printf ("Error: Unable to read track: %s\n", pTarget->trackFile ? pTarget->trackFile : "-");
+  if (fflush (stdout) != 0 || ferror (stdout)) ok = false;
+  free (line);
+  if (file != stdin) fclose (file);
+  return ok;
+}
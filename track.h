@@ -0,0 +1,21 @@
+#include "sunwait.h"
+
+#ifndef TRACK_H
+  #define TRACK_H
+
+/* The sun's declination and subsolar longitude are re-anchored this often, and interpolated between */
+#define TRACK_ANCHOR_SECONDS 3600.0
+
+/* Longer gaps between fixes are searched in steps of this, so a rise and set between them both show */
+#define TRACK_STEP_SECONDS   600.0
+
+/*
+** 'track [FILE]': read a time-stamped track, one "YYYY-MM-DDTHH:MM[:SS] latitude longitude" fix
+** per line (decimal degrees, N and E positive, separated by spaces, tabs or commas), from FILE or
+** standard input. Print "time,rise|set,latitude,longitude" where the sun crosses the twilight
+** angle along the track, position interpolated between fixes. False if the track could not be
+** opened or read, or the output could not be written.
+*/
+boolean run_track (targetStruct *pTarget);
+
+#endif
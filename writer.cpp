@@ -0,0 +1,315 @@
+/*
+** writer.cpp - double-buffered bulk output through io_uring
+**
+** There is no liburing here, so the ring is set up with the raw system calls: one submission at a
+** time, as a block only goes once the previous one has completed, which also keeps the output
+** in order on pipes. Files of our own are written at explicit offsets, standard output at its file
+** position, whatever that is. With O_DIRECT every write is whole aligned blocks, so the last one
+** is padded and the file truncated back afterwards.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "sunwait.h"
+#include "writer.h"
+
+typedef struct
+{
+  int                    fd;
+  unsigned int           features;
+  unsigned int          *sqHead;
+  unsigned int          *sqTail;
+  unsigned int          *sqMask;
+  unsigned int          *sqArray;
+  struct io_uring_sqe   *sqes;
+  unsigned int          *cqHead;
+  unsigned int          *cqTail;
+  unsigned int          *cqMask;
+  struct io_uring_cqe   *cqes;
+  void                  *sqRing;
+  void                  *cqRing;
+  size_t                 sqRingSize;
+  size_t                 cqRingSize;
+  size_t                 sqesSize;
+} ringStruct;
+
+struct writerStruct
+{
+  int          fd;
+  boolean      close;       // Our own file, not standard output
+  boolean      seekable;    // Regular file of our own: explicit offsets. Else the file position
+  boolean      direct;      // Opened O_DIRECT
+  boolean      ok;
+  OnOff        debug;
+  ringStruct   ring;
+  boolean      ringUp;      // Else plain write()
+  char        *block[2];
+  size_t       fill;        // Bytes in block[current]
+  int          current;
+  boolean      inFlight;    // block[1 - current] is being written
+  size_t       inFlightSize;
+  unsigned long long offset;   // File offset of the next block
+  unsigned long long bytes;    // Real output, without O_DIRECT padding
+  unsigned long blocks;
+  double       stalled;     // Seconds spent waiting for the kernel
+};
+
+static int ringSetup (unsigned int pEntries, struct io_uring_params *pParams)
+{
+  return (int) syscall (__NR_io_uring_setup, pEntries, pParams);
+}
+
+static int ringEnter (int pFd, unsigned int pSubmit, unsigned int pComplete, unsigned int pFlags)
+{
+  return (int) syscall (__NR_io_uring_enter, pFd, pSubmit, pComplete, pFlags, NULL, 0);
+}
+
+static boolean ringOpen (ringStruct *pRing)
+{
+  struct io_uring_params params;
+  memset (&params, 0, sizeof (params));
+  memset (pRing, 0, sizeof (*pRing));
+  pRing->fd = ringSetup (4, &params);
+  if (pRing->fd < 0) return false;
+  pRing->features = params.features;
+
+  pRing->sqRingSize = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+  pRing->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    pRing->sqRingSize = pRing->cqRingSize = pRing->sqRingSize > pRing->cqRingSize ? pRing->sqRingSize : pRing->cqRingSize;
+
+  pRing->sqRing = mmap (NULL, pRing->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->fd, IORING_OFF_SQ_RING);
+  pRing->cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? pRing->sqRing
+                : mmap (NULL, pRing->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->fd, IORING_OFF_CQ_RING);
+  pRing->sqesSize = params.sq_entries * sizeof (struct io_uring_sqe);
+  pRing->sqes = (struct io_uring_sqe *) mmap (NULL, pRing->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->fd, IORING_OFF_SQES);
+  if (pRing->sqRing == MAP_FAILED || pRing->cqRing == MAP_FAILED || pRing->sqes == MAP_FAILED)
+  { if (pRing->sqRing != MAP_FAILED) munmap (pRing->sqRing, pRing->sqRingSize);
+    if (pRing->cqRing != MAP_FAILED && pRing->cqRing != pRing->sqRing) munmap (pRing->cqRing, pRing->cqRingSize);
+    if (pRing->sqes != MAP_FAILED) munmap (pRing->sqes, pRing->sqesSize);
+    close (pRing->fd);
+    return false;
+  }
+
+  char *sq = (char *) pRing->sqRing, *cq = (char *) pRing->cqRing;
+  pRing->sqHead  = (unsigned int *) (sq + params.sq_off.head);
+  pRing->sqTail  = (unsigned int *) (sq + params.sq_off.tail);
+  pRing->sqMask  = (unsigned int *) (sq + params.sq_off.ring_mask);
+  pRing->sqArray = (unsigned int *) (sq + params.sq_off.array);
+  pRing->cqHead  = (unsigned int *) (cq + params.cq_off.head);
+  pRing->cqTail  = (unsigned int *) (cq + params.cq_off.tail);
+  pRing->cqMask  = (unsigned int *) (cq + params.cq_off.ring_mask);
+  pRing->cqes    = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+  return true;
+}
+
+static void ringClose (ringStruct *pRing)
+{
+  munmap (pRing->sqes, pRing->sqesSize);
+  if (pRing->cqRing != pRing->sqRing) munmap (pRing->cqRing, pRing->cqRingSize);
+  munmap (pRing->sqRing, pRing->sqRingSize);
+  close (pRing->fd);
+}
+
+/*
+** The tail is published before the kernel is entered, as it reads the SQE from there; so if the
+** enter fails, the SQE is still queued and the ring must not be entered again: see submit()
+*/
+static boolean ringSubmitWrite (ringStruct *pRing, int pFd, const void *pData, size_t pSize, long long pOffset)
+{
+  unsigned int tail  = __atomic_load_n (pRing->sqTail, __ATOMIC_RELAXED);
+  unsigned int index = tail & *pRing->sqMask;
+  struct io_uring_sqe *sqe = &pRing->sqes[index];
+  memset (sqe, 0, sizeof (*sqe));
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd     = pFd;
+  sqe->addr   = (unsigned long long) (uintptr_t) pData;
+  sqe->len    = (unsigned int) pSize;
+  sqe->off    = (unsigned long long) pOffset;   // -1: the file position, for pipes
+  pRing->sqArray[index] = index;
+  __atomic_store_n (pRing->sqTail, tail + 1, __ATOMIC_RELEASE);
+  return ringEnter (pRing->fd, 1, 0, 0) == 1;
+}
+
+/* Result of the one write in flight: bytes written, or -errno */
+static int ringWait (ringStruct *pRing)
+{
+  unsigned int head = __atomic_load_n (pRing->cqHead, __ATOMIC_RELAXED);
+  while (head == __atomic_load_n (pRing->cqTail, __ATOMIC_ACQUIRE))
+    if (ringEnter (pRing->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return -errno;
+  int result = pRing->cqes[head & *pRing->cqMask].res;
+  __atomic_store_n (pRing->cqHead, head + 1, __ATOMIC_RELEASE);
+  return result;
+}
+
+/* Synchronous write of what is left, for the fallback and for short writes */
+static boolean writeAll (writerStruct *pWriter, const char *pData, size_t pSize, unsigned long long pOffset)
+{
+  while (pSize > 0)
+  { ssize_t written = pWriter->seekable ? pwrite (pWriter->fd, pData, pSize, pOffset) : write (pWriter->fd, pData, pSize);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    pData   += written;
+    pSize   -= written;
+    pOffset += written;
+  }
+  return true;
+}
+
+/* Wait for the block in flight, if any, and finish it if the kernel wrote it short */
+static void complete (writerStruct *pWriter)
+{
+  if (!pWriter->inFlight) return;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  int result = ringWait (&pWriter->ring);
+  pWriter->stalled += std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+  pWriter->inFlight = false;
+
+  const char *block = pWriter->block[1 - pWriter->current];
+  unsigned long long offset = pWriter->offset - pWriter->inFlightSize;
+
+  /* A kernel without IORING_OP_WRITE (before 5.6): write() from here on, starting with this block */
+  if (result == -EINVAL || result == -EOPNOTSUPP)
+  { ringClose (&pWriter->ring);
+    pWriter->ringUp = false;
+    pWriter->ok = writeAll (pWriter, block, pWriter->inFlightSize, offset) && pWriter->ok;
+  }
+  else if (result < 0) pWriter->ok = false;
+  else if ((size_t) result < pWriter->inFlightSize && !pWriter->direct)
+    pWriter->ok = writeAll (pWriter, block + result, pWriter->inFlightSize - result, offset + result) && pWriter->ok;
+  else if ((size_t) result < pWriter->inFlightSize) pWriter->ok = false;
+}
+
+/* Send the current block, pSize bytes of it, and switch to the other */
+static void submit (writerStruct *pWriter, size_t pSize)
+{
+  complete (pWriter);
+  pWriter->blocks++;
+  if (pWriter->ringUp && ringSubmitWrite (&pWriter->ring, pWriter->fd, pWriter->block[pWriter->current], pSize, pWriter->seekable ? (long long) pWriter->offset : -1))
+  { pWriter->inFlight     = true;
+    pWriter->inFlightSize = pSize;
+  }
+  else
+  { /* Retire a ring that failed to take the block: closing it drops the SQE left queued */
+    if (pWriter->ringUp)
+    { ringClose (&pWriter->ring);
+      pWriter->ringUp = false;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    pWriter->ok = writeAll (pWriter, pWriter->block[pWriter->current], pSize, pWriter->offset) && pWriter->ok;
+    pWriter->stalled += std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+  }
+  pWriter->offset += pSize;
+  pWriter->current = 1 - pWriter->current;
+  pWriter->fill    = 0;
+}
+
+writerStruct *writer_open (const char *pFileName, OnOff pDirect, OnOff pDebug)
+{
+  writerStruct *writer = (writerStruct *) calloc (1, sizeof (writerStruct));
+  if (!writer) return NULL;
+  writer->ok    = true;
+  writer->debug = pDebug;
+
+  if (!pFileName)
+  { fflush (stdout);   /* Anything printf'ed so far goes first */
+    writer->fd = STDOUT_FILENO;
+  }
+  else
+  { writer->close = true;
+    if (pDirect == ONOFF_ON)
+    { writer->fd = open (pFileName, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+      writer->direct = writer->fd >= 0;
+      if (!writer->direct && pDebug == ONOFF_ON) printf ("Debug: Writer - O_DIRECT not supported for %s, buffered instead\n", pFileName);
+    }
+    if (!writer->direct) writer->fd = open (pFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0)
+    { printf ("Error: Unable to create %s\n", pFileName);
+      free (writer);
+      return NULL;
+    }
+  }
+
+  /*
+  ** Standard output may be a file already written to, or still to be written to after us: only
+  ** files of our own are written at explicit offsets, anything else at, and advancing, its position
+  */
+  struct stat status;
+  writer->seekable = writer->close && fstat (writer->fd, &status) == 0 && S_ISREG (status.st_mode);
+  if (!writer->seekable) writer->direct = false;
+
+  for (int i=0; i < 2; i++)
+    if (posix_memalign ((void **) &writer->block[i], WRITER_ALIGNMENT, WRITER_BLOCK) != 0) writer->block[i] = NULL;
+  if (!writer->block[0] || !writer->block[1])
+  { printf ("Error: Unable to allocate output buffers\n");
+    free (writer->block[0]);
+    free (writer->block[1]);
+    if (writer->close) close (writer->fd);
+    free (writer);
+    return NULL;
+  }
+
+  writer->ringUp = ringOpen (&writer->ring);
+
+  /* Offset -1, the file position, needs IORING_FEAT_RW_CUR_POS (5.6) */
+  if (writer->ringUp && !writer->seekable && !(writer->ring.features & IORING_FEAT_RW_CUR_POS))
+  { ringClose (&writer->ring);
+    writer->ringUp = false;
+  }
+  return writer;
+}
+
+void writer_write (writerStruct *pWriter, const void *pData, size_t pSize)
+{
+  const char *data = (const char *) pData;
+  pWriter->bytes += pSize;
+  while (pSize > 0)
+  { size_t part = WRITER_BLOCK - pWriter->fill < pSize ? WRITER_BLOCK - pWriter->fill : pSize;
+    memcpy (pWriter->block[pWriter->current] + pWriter->fill, data, part);
+    pWriter->fill += part;
+    data  += part;
+    pSize -= part;
+    if (pWriter->fill == WRITER_BLOCK) submit (pWriter, WRITER_BLOCK);
+  }
+}
+
+boolean writer_close (writerStruct *pWriter)
+{
+  if (!pWriter) return false;
+
+  /* O_DIRECT writes whole aligned blocks: pad the last, then cut the file back */
+  if (pWriter->fill > 0)
+  { size_t size = pWriter->fill;
+    if (pWriter->direct)
+    { size = (size + WRITER_ALIGNMENT - 1) / WRITER_ALIGNMENT * WRITER_ALIGNMENT;
+      memset (pWriter->block[pWriter->current] + pWriter->fill, 0, size - pWriter->fill);
+    }
+    submit (pWriter, size);
+  }
+  complete (pWriter);
+  if (pWriter->direct && ftruncate (pWriter->fd, pWriter->bytes) != 0) pWriter->ok = false;
+
+  if (pWriter->debug == ONOFF_ON)
+    printf ( "Debug: Writer - %s%s, %llu bytes in %lu blocks, %.3f seconds waiting for writes\n"
+           , pWriter->ringUp ? "io_uring" : "write()", pWriter->direct ? ", O_DIRECT" : ""
+           , pWriter->bytes, pWriter->blocks, pWriter->stalled);
+
+  if (pWriter->ringUp) ringClose (&pWriter->ring);
+  if (pWriter->close && close (pWriter->fd) != 0) pWriter->ok = false;
+  boolean ok = pWriter->ok;
+  if (!ok) printf ("Error: Writing output failed\n");
+  free (pWriter->block[0]);
+  free (pWriter->block[1]);
+  free (pWriter);
+  return ok;
+}
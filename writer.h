@@ -0,0 +1,27 @@
+#include <stddef.h>
+#include "sunwait.h"
+
+#ifndef WRITER_H
+  #define WRITER_H
+
+/* Size of each of the two output blocks, a multiple of WRITER_ALIGNMENT */
+#define WRITER_BLOCK     (4 << 20)
+
+/* Buffer, size and offset alignment O_DIRECT needs */
+#define WRITER_ALIGNMENT 4096
+
+/*
+** Bulk output for large exports. Output collects in one of two aligned blocks; a full block is
+** handed to the kernel through io_uring while the other fills, so formatting and computing go on
+** during the disk write. Where io_uring is not available, blocks go out with write().
+*/
+typedef struct writerStruct writerStruct;
+
+/* pFileName NULL: standard output. pDirect: O_DIRECT, where the file system allows it */
+writerStruct *writer_open  (const char *pFileName, OnOff pDirect, OnOff pDebug);
+void          writer_write (writerStruct *pWriter, const void *pData, size_t pSize);
+
+/* Flush, wait for every write and close. False if any write failed */
+boolean       writer_close (writerStruct *pWriter);
+
+#endif